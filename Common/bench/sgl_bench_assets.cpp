@@ -0,0 +1,458 @@
+/// Asset loading benchmark: loads every OBJ, MTL and texture file under a models directory
+/// a number of times, without any window or GL context, and prints a JSON report to stdout.
+///
+/// Usage: sgl_bench_assets [--runs N] [--threads N] [--compressed] [models_dir]
+
+#include "sgl_assets.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <new>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+namespace fs = std::filesystem;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// ALLOCATION COUNTING
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::atomic<uint64_t> num_allocations{ 0 };
+static std::atomic<uint64_t> allocated_bytes{ 0 };
+
+static void* counted_alloc(size_t size)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+static void* counted_aligned_alloc(size_t size, std::align_val_t align)
+{
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+#if defined(_WIN32)
+    return _aligned_malloc(size ? size : 1, size_t(align));
+#else
+    void* ptr = nullptr;
+    return posix_memalign(&ptr, std::max(size_t(align), sizeof(void*)), size ? size : 1) == 0 ? ptr : nullptr;
+#endif
+}
+
+static void aligned_free(void* ptr)
+{
+#if defined(_WIN32)
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* operator new(size_t size) { if (void* p = counted_alloc(size)) return p; throw std::bad_alloc(); }
+void* operator new[](size_t size) { if (void* p = counted_alloc(size)) return p; throw std::bad_alloc(); }
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return counted_alloc(size); }
+void* operator new(size_t size, std::align_val_t align) { if (void* p = counted_aligned_alloc(size, align)) return p; throw std::bad_alloc(); }
+void* operator new[](size_t size, std::align_val_t align) { if (void* p = counted_aligned_alloc(size, align)) return p; throw std::bad_alloc(); }
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::align_val_t) noexcept { aligned_free(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { aligned_free(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { aligned_free(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { aligned_free(ptr); }
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MEASUREMENTS
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Peak resident set size of the process so far, in KiB
+static size_t peak_rss_kb()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return 0;
+    return counters.PeakWorkingSetSize / 1024;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024; // bytes
+#else
+    return usage.ru_maxrss;
+#endif
+#endif
+}
+
+/// Time and heap allocations spent on some work, accumulated over runs
+struct Cost {
+    double seconds = 0.0;
+    uint64_t allocations = 0;
+    uint64_t bytes = 0;
+
+    Cost& operator+=(const Cost& o) {
+        seconds += o.seconds; allocations += o.allocations; bytes += o.bytes;
+        return *this;
+    }
+};
+
+/// Measures the cost of consecutive pieces of work
+class CostMeter final {
+    using Clock = std::chrono::steady_clock;
+    Clock::time_point time_;
+    uint64_t allocations_ = 0;
+    uint64_t bytes_ = 0;
+
+    public:
+    CostMeter() { reset(); }
+
+    /// Start measuring from now
+    void reset() {
+        time_ = Clock::now();
+        allocations_ = num_allocations.load(std::memory_order_relaxed);
+        bytes_ = allocated_bytes.load(std::memory_order_relaxed);
+    }
+
+    /// Cost since the last reset or lap, then start measuring again
+    Cost lap() {
+        const Cost cost = {
+            std::chrono::duration<double>(Clock::now() - time_).count(),
+            num_allocations.load(std::memory_order_relaxed) - allocations_,
+            allocated_bytes.load(std::memory_order_relaxed) - bytes_,
+        };
+        reset();
+        return cost;
+    }
+};
+
+/// Stages reported per file, the model loading ones first
+enum Stage {
+    STAGE_UPLOAD_PREP = int(sgl::LoadStage::COUNT),
+    STAGE_DECODE,
+    STAGE_COUNT,
+};
+
+static const char* const kStageNames[STAGE_COUNT] = {
+    "read", "tokenize", "dedupe", "simplify", "optimize", "cook", "upload_prep", "decode",
+};
+
+/// Costs of a file over all its runs
+struct FileReport {
+    std::string path;
+    std::string type;
+    uint64_t file_bytes = 0;
+    size_t triangles = 0;
+    size_t peak_rss_kb = 0;
+    Cost total;
+    Cost stages[STAGE_COUNT];
+    bool has_stage[STAGE_COUNT] = {};
+    Cost cooked; // loading from the mesh/texture cache, not for materials
+    bool has_cooked = false;
+
+    void add_stage(int stage, const Cost& cost) {
+        stages[stage] += cost;
+        has_stage[stage] = true;
+    }
+};
+
+/// Loading stage hook: charges the cost since the previous stage to the stage that ended
+struct StageRecorder {
+    CostMeter meter;
+    FileReport* report = nullptr;
+
+    static void on_stage(sgl::LoadStage stage, void* cookie) {
+        auto* self = static_cast<StageRecorder*>(cookie);
+        self->report->add_stage(int(stage), self->meter.lap());
+    }
+};
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BENCHMARKS
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct BenchOptions {
+    unsigned runs = 5;
+    unsigned threads = 0;
+    bool compressed = false;
+    fs::path models_dir = "3D_Models";
+    fs::path cache_dir;
+};
+
+static bool bench_model(const BenchOptions& bench, FileReport& report)
+{
+    StageRecorder recorder;
+    recorder.report = &report;
+
+    sgl::ModelLoadOptions options;
+    options.threads = bench.threads;
+    options.cache = false;
+    options.vertex_format = bench.compressed ? sgl::VertexFormat::COMPRESSED : sgl::VertexFormat::FLOAT;
+    options.stage_hook = &StageRecorder::on_stage;
+    options.stage_cookie = &recorder;
+
+    for (unsigned run = 0; run < bench.runs; run++) {
+        CostMeter total;
+        recorder.meter.reset();
+        sgl::ModelRef model = sgl::parse_model(report.path, options);
+        if (!model)
+            return false;
+        recorder.meter.reset();
+        const sgl::MeshUploadData upload = sgl::prepare_mesh_upload(model->mesh);
+        report.add_stage(STAGE_UPLOAD_PREP, recorder.meter.lap());
+        report.total += total.lap();
+
+        report.triangles = 0;
+        for (const sgl::SubMesh& submesh : model->mesh.submeshes)
+            report.triangles += submesh.index_count / 3;
+    }
+
+    // Loading from the mesh cache, once cooked
+    options.cache = true;
+    options.cache_dir = bench.cache_dir.string();
+    options.stage_hook = nullptr;
+    if (!sgl::parse_model(report.path, options))
+        return false;
+    for (unsigned run = 0; run < bench.runs; run++) {
+        CostMeter total;
+        sgl::ModelRef model = sgl::parse_model(report.path, options);
+        if (!model)
+            return false;
+        const sgl::MeshUploadData upload = sgl::prepare_mesh_upload(model->mesh);
+        report.cooked += total.lap();
+    }
+    report.has_cooked = true;
+    return true;
+}
+
+static bool bench_mtl(const BenchOptions& bench, FileReport& report)
+{
+    for (unsigned run = 0; run < bench.runs; run++) {
+        CostMeter total;
+        if (!sgl::load_mtl(report.path))
+            return false;
+        report.total += total.lap();
+    }
+    return true;
+}
+
+static bool bench_texture(const BenchOptions& bench, FileReport& report)
+{
+    sgl::TextureCookOptions options;
+    options.cache_dir = bench.cache_dir.string();
+
+    for (unsigned run = 0; run < bench.runs; run++) {
+        CostMeter total, stage;
+        const auto file = sgl::FileView::open(report.path);
+        if (!file)
+            return false;
+        report.add_stage(int(sgl::LoadStage::READ), stage.lap());
+        int width, height, channels;
+        stbi_set_flip_vertically_on_load(true);
+        stbi_uc* pixels = stbi_load_from_memory(reinterpret_cast<const stbi_uc*>(file->data()), int(file->size()),
+                                                &width, &height, &channels, 0);
+        if (!pixels)
+            return false;
+        report.add_stage(STAGE_DECODE, stage.lap());
+        const sgl::CookedTexture cooked = sgl::cook_texture(pixels, width, height, channels, options);
+        stbi_image_free(pixels);
+        report.add_stage(int(sgl::LoadStage::COOK), stage.lap());
+        report.total += total.lap();
+        if (run == 0)
+            sgl::save_cooked_texture(report.path, cooked, options);
+    }
+
+    // Loading from the texture cache, once cooked
+    for (unsigned run = 0; run < bench.runs; run++) {
+        CostMeter total;
+        if (!sgl::load_cooked_texture(report.path, options))
+            return false;
+        report.cooked += total.lap();
+    }
+    report.has_cooked = true;
+    return true;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// REPORT
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Escape a string for a JSON string literal
+static std::string json_string(std::string_view str)
+{
+    std::string out = "\"";
+    for (char c : str) {
+        if (c == '"' || c == '\\') { out += '\\'; out += c; }
+        else if (static_cast<unsigned char>(c) < 0x20) { char buf[8]; std::snprintf(buf, sizeof(buf), "\\u%04x", c); out += buf; }
+        else out += c;
+    }
+    return out + "\"";
+}
+
+/// JSON object of a cost, averaged per run
+static std::string json_cost(const Cost& cost, unsigned runs, uint64_t file_bytes)
+{
+    const double seconds = cost.seconds / runs;
+    char buf[256];
+    std::snprintf(buf, sizeof(buf), "{ \"seconds\": %.9f, \"mb_per_s\": %.3f, \"allocations\": %llu, \"allocated_bytes\": %llu }",
+                  seconds, seconds > 0 ? file_bytes / seconds / 1e6 : 0.0,
+                  (unsigned long long)(cost.allocations / runs), (unsigned long long)(cost.bytes / runs));
+    return buf;
+}
+
+static void print_json(const BenchOptions& bench, const std::vector<FileReport>& reports)
+{
+    Cost total;
+    uint64_t total_bytes = 0;
+    std::printf("{\n  \"runs\": %u,\n  \"threads\": %u,\n  \"vertex_format\": \"%s\",\n  \"files\": [\n",
+                bench.runs, bench.threads, bench.compressed ? "compressed" : "float");
+    for (size_t i = 0; i < reports.size(); i++) {
+        const FileReport& r = reports[i];
+        const double seconds = r.total.seconds / bench.runs;
+        std::printf("    {\n      \"path\": %s,\n      \"type\": \"%s\",\n      \"bytes\": %llu,\n",
+                    json_string(r.path).c_str(), r.type.c_str(), (unsigned long long)r.file_bytes);
+        if (r.type == "obj")
+            std::printf("      \"triangles\": %zu,\n      \"triangles_per_s\": %.1f,\n", r.triangles, seconds > 0 ? r.triangles / seconds : 0.0);
+        std::printf("      \"total\": %s,\n", json_cost(r.total, bench.runs, r.file_bytes).c_str());
+        std::printf("      \"stages\": {");
+        const char* sep = "";
+        for (int s = 0; s < STAGE_COUNT; s++) {
+            if (!r.has_stage[s])
+                continue;
+            std::printf("%s\n        \"%s\": %s", sep, kStageNames[s], json_cost(r.stages[s], bench.runs, r.file_bytes).c_str());
+            sep = ",";
+        }
+        std::printf("\n      },\n");
+        if (r.has_cooked)
+            std::printf("      \"cooked\": %s,\n", json_cost(r.cooked, bench.runs, r.file_bytes).c_str());
+        std::printf("      \"peak_rss_kb\": %zu\n    }%s\n", r.peak_rss_kb, i + 1 < reports.size() ? "," : "");
+        total += r.total;
+        total_bytes += r.file_bytes;
+    }
+    std::printf("  ],\n  \"total\": %s,\n  \"peak_rss_kb\": %zu\n}\n",
+                json_cost(total, bench.runs, total_bytes).c_str(), peak_rss_kb());
+}
+
+static void print_summary(const BenchOptions& bench, const std::vector<FileReport>& reports)
+{
+    std::fprintf(stderr, "%-60s %10s %10s %12s %10s\n", "file", "ms", "MB/s", "allocs", "cooked ms");
+    for (const FileReport& r : reports) {
+        const double seconds = r.total.seconds / bench.runs;
+        std::fprintf(stderr, "%-60s %10.3f %10.2f %12llu", r.path.c_str(), seconds * 1e3,
+                     seconds > 0 ? r.file_bytes / seconds / 1e6 : 0.0, (unsigned long long)(r.total.allocations / bench.runs));
+        if (r.has_cooked)
+            std::fprintf(stderr, " %10.3f", r.cooked.seconds / bench.runs * 1e3);
+        std::fprintf(stderr, "\n");
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MAIN
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static std::string lowercase_extension(const fs::path& path)
+{
+    std::string ext = path.extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+    return ext;
+}
+
+int main(int argc, char* argv[])
+{
+    BenchOptions bench;
+    for (int i = 1; i < argc; i++) {
+        const std::string_view arg = argv[i];
+        if (arg == "--runs" && i + 1 < argc)
+            bench.runs = std::max(1, std::atoi(argv[++i]));
+        else if (arg == "--threads" && i + 1 < argc)
+            bench.threads = std::max(0, std::atoi(argv[++i]));
+        else if (arg == "--compressed")
+            bench.compressed = true;
+        else if (!arg.empty() && arg[0] != '-')
+            bench.models_dir = arg;
+        else {
+            std::fprintf(stderr, "Usage: %s [--runs N] [--threads N] [--compressed] [models_dir]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // keep stdout for the JSON report
+    spdlog::set_default_logger(spdlog::stderr_color_mt("bench"));
+    spdlog::set_level(spdlog::level::warn);
+
+    std::error_code ec;
+    std::vector<fs::path> files;
+    for (auto it = fs::recursive_directory_iterator(bench.models_dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        if (it->is_regular_file())
+            files.push_back(it->path());
+    }
+    if (ec) {
+        std::fprintf(stderr, "Failed to list %s: %s\n", bench.models_dir.string().c_str(), ec.message().c_str());
+        return 1;
+    }
+    std::sort(files.begin(), files.end());
+
+    bench.cache_dir = fs::temp_directory_path(ec) / "sgl_bench_assets";
+    fs::create_directories(bench.cache_dir, ec);
+
+    std::vector<FileReport> reports;
+    bool failed = false;
+    for (const fs::path& path : files) {
+        const std::string ext = lowercase_extension(path);
+        FileReport report;
+        report.path = path.generic_string();
+        report.file_bytes = fs::file_size(path, ec);
+        bool ok;
+        if (ext == ".obj") {
+            report.type = "obj";
+            ok = bench_model(bench, report);
+        } else if (ext == ".mtl") {
+            report.type = "mtl";
+            ok = bench_mtl(bench, report);
+        } else if (ext == ".png" || ext == ".jpg" || ext == ".jpeg" || ext == ".bmp" || ext == ".tga") {
+            report.type = "texture";
+            ok = bench_texture(bench, report);
+        } else {
+            continue;
+        }
+        if (!ok) {
+            std::fprintf(stderr, "Failed to load %s\n", report.path.c_str());
+            failed = true;
+            continue;
+        }
+        report.peak_rss_kb = peak_rss_kb();
+        reports.push_back(std::move(report));
+    }
+    fs::remove_all(bench.cache_dir, ec);
+
+    print_json(bench, reports);
+    print_summary(bench, reports);
+    return failed ? 1 : 0;
+}
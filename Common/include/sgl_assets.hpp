@@ -0,0 +1,337 @@
+#pragma once
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+
+#include <glad/glad.h>
+
+#include <spdlog/spdlog.h>
+
+/// Simple Graphics Library: asset loading (OBJ models, MTL materials), independent of any window or GL context
+namespace sgl {
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LOG
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define TRACE SPDLOG_TRACE
+#define DEBUG SPDLOG_DEBUG
+#define INFO SPDLOG_INFO
+#define WARN SPDLOG_WARN
+#define ERROR SPDLOG_ERROR
+#define CRITICAL SPDLOG_CRITICAL
+#define ABORT_MSG(...) do { CRITICAL(__VA_ARGS__); std::abort(); } while (0)
+#define ASSERT_MSG(expr, ...) do { if (expr) { } else { ABORT_MSG(__VA_ARGS__); } } while (0)
+#define ASSERT(expr) ASSERT_MSG(expr, "Assertion failed: ({})", #expr)
+#define ASSERT_RET(expr) [&]{ auto ret = (expr); ASSERT_MSG(ret, "Assertion failed: ({})", #expr); return ret; }()
+#define DBG(expr) [&]{ auto ret = (expr); DEBUG("({}) = {{{}}}", #expr, ret); return ret; }()
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// UTILS
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Default core reference type
+template<typename ...T>
+using Ref = std::shared_ptr<T...>;
+
+/// Read file contents to a string
+auto read_file_to_string(const std::string& filename) -> std::optional<std::string>;
+
+/// Read-only view of a file contents, memory-mapped when possible, read into memory otherwise
+class FileView final {
+    const char* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::unique_ptr<char[]> buffer_; // fallback storage when mapping is not possible
+
+    FileView() = default;
+
+    public:
+    ~FileView();
+
+    // Movable but not Copyable
+    FileView(FileView&& o);
+    FileView(const FileView&) = delete;
+    FileView& operator=(FileView&& o);
+    FileView& operator=(const FileView&) = delete;
+
+    public:
+    /// Open a file and map its whole contents
+    static auto open(const std::string& filename) -> std::optional<FileView>;
+
+    [[nodiscard]] const char* data() const { return data_; }
+    [[nodiscard]] size_t size() const { return size_; }
+    [[nodiscard]] std::string_view str() const { return { data_, size_ }; }
+    [[nodiscard]] bool is_mapped() const { return mapped_; }
+};
+
+/// Size in bytes of a GL index type
+size_t index_type_size(GLenum type);
+
+/// Parse a fixed-format decimal ([-]digits[.digits]) followed by a blank or the end, giving the same
+/// float as std::from_chars. Returns the end of the number, or nullptr for any other form (exponents,
+/// too many digits, ambiguous rounding) left for std::from_chars. Reads up to 16 bytes past `p` when available.
+const char* parse_fixed_float(const char* p, const char* end, float& value);
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MATERIAL
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Texture in GPU memory, defined by the renderer
+struct GLTexture;
+using GLTextureRef = Ref<GLTexture>;
+
+struct Material {
+    std::string name;
+    float ka = 1.0f;
+    float kd = 1.0f;
+    float ks = 1.0f;
+    float q  = 1.0f;
+    std::string diffuse_map; // path of the diffuse texture file
+    GLTextureRef diffuse_tex;
+
+    Ref<Material> to_ref() { return std::make_shared<Material>(std::move(*this)); }
+};
+using MaterialRef = Ref<Material>;
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MESH/MODEL
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Range of a mesh index buffer drawn with a single material
+struct SubMesh {
+    size_t index_offset = 0;
+    size_t index_count = 0;
+    MaterialRef material;
+};
+
+/// Simplified level of a mesh: index ranges into the same buffers as the full detail submeshes
+struct MeshLod {
+    std::vector<SubMesh> submeshes;
+    float error = 0.f; // geometric deviation from the full detail mesh, in mesh units
+};
+
+/// Layout of mesh vertices in GPU memory
+enum class VertexFormat {
+    FLOAT,      // 32 bytes: float position, texcoord and normal
+    COMPRESSED, // 16 bytes: 16-bit position quantized to the mesh bounds, half float texcoord, octahedral 16-bit normal
+};
+
+/// Represents one mesh with its vertices, indices and per-material ranges
+struct Mesh {
+    static constexpr size_t kFloatsPerVertex = 3 + 2 + 3; // position, texcoord, normal
+
+    std::vector<float> vertices;       // unique interleaved vertices
+    std::vector<unsigned int> indices; // triangle list into vertices, grouped by material
+    std::vector<SubMesh> submeshes;    // one index range per material
+    std::vector<MeshLod> lods;         // coarser levels of detail, by increasing error
+    glm::vec3 center{ 0.f };           // bounding sphere
+    float radius = 0.f;
+    VertexFormat vertex_format = VertexFormat::FLOAT; // layout used when uploaded by create_mesh
+
+    /// Vertex/index data mapped from a cooked mesh file, ready for upload.
+    /// When present, `vertices` and `indices` are left empty.
+    struct Cooked {
+        Ref<FileView> file;
+        const float* vertices = nullptr;
+        size_t num_vertices = 0;
+        const void* indices = nullptr;
+        size_t num_indices = 0;
+        GLenum index_type = GL_UNSIGNED_INT;
+    };
+    std::optional<Cooked> cooked;
+
+    size_t num_vertices() const { return cooked ? cooked->num_vertices : vertices.size() / kFloatsPerVertex; }
+    size_t num_indices() const { return cooked ? cooked->num_indices : indices.size(); }
+
+    /// Smallest GL index type able to address every vertex
+    GLenum index_type() const { return num_vertices() <= 0x10000 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT; }
+};
+
+/// Represents a loaded Model file, all its submeshes share the same vertex/index buffers
+struct Model {
+    Mesh mesh;
+    std::vector<MaterialRef> materials; // every material from the model MTL libraries
+    std::vector<std::string> sources;   // files the model is built from: the OBJ file, then its MTL libraries
+};
+using ModelRef = Ref<Model>;
+
+/// Steps of loading a Model file, in order (a model found in the mesh cache only goes through READ)
+enum class LoadStage {
+    READ,     // open/map the file
+    TOKENIZE, // parse text records
+    DEDUPE,   // resolve face corners into unique vertices, load materials
+    SIMPLIFY, // generate levels of detail
+    OPTIMIZE, // reorder for the vertex caches
+    COOK,     // save to the mesh cache
+    COUNT,    // must be last
+};
+
+typedef void (* FnLoadStageHook)(LoadStage stage, void* cookie);
+
+/// Options for loading Model files
+struct ModelLoadOptions {
+    unsigned threads = 0;  // max threads parsing the file in parallel, 0 for one per hardware thread
+    bool cache = true;     // load from/save to a cooked binary mesh file instead of parsing text
+    bool optimize = true;  // reorder triangles and vertices for the GPU vertex caches (done once when cooked)
+    unsigned lod_levels = 3; // simplified levels of detail to generate, each halving the triangles
+    float lod_error = 0.05f; // max simplification error, relative to the mesh radius
+    std::string cache_dir; // where to keep cooked mesh files, empty for next to the source file
+    VertexFormat vertex_format = VertexFormat::FLOAT; // GPU vertex layout of the loaded mesh
+    FnLoadStageHook stage_hook = nullptr; // called as each loading stage ends, for profiling
+    void* stage_cookie = nullptr;
+};
+
+/// Load every Material from a MTL file (textures are left for the caller to load)
+auto load_mtl(const std::string& filename) -> std::optional<std::vector<MaterialRef>>;
+
+/// Load an OBJ model meshes and materials from file, without the material textures
+/// (a cooked copy is kept in the mesh cache and reused while the OBJ/MTL files are unchanged)
+ModelRef parse_model(std::string_view filepath, const ModelLoadOptions& options = {});
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TEXTURE
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+// EXT_texture_compression_s3tc
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+/// Layout of texture pixels in GPU memory
+enum class TextureFormat : uint32_t {
+    RGB8,  // 3 bytes per pixel
+    RGBA8, // 4 bytes per pixel
+    BC1,   // 8 bytes per 4x4 block, opaque (S3TC DXT1)
+    BC3,   // 16 bytes per 4x4 block, with alpha (S3TC DXT5)
+};
+
+/// Options for cooking textures
+struct TextureCookOptions {
+    bool cache = true;     // load from/save to a cooked texture file instead of decoding the image
+    bool compress = true;  // encode to BC1 (opaque) or BC3 (with alpha), 4-8x smaller in GPU memory
+    std::string cache_dir; // where to keep cooked texture files, empty for next to the source file
+};
+
+/// Texture with its whole mip chain in a GPU format, ready for upload
+struct CookedTexture {
+    struct Level {
+        uint32_t width = 0, height = 0;
+        const uint8_t* data = nullptr;
+        size_t size = 0;
+    };
+    TextureFormat format = TextureFormat::RGBA8;
+    std::vector<Level> levels; // from the full size image down to 1x1
+
+    Ref<FileView> file;            // cooked file the levels are mapped from, when loaded from the cache
+    std::vector<uint8_t> storage;  // levels of a freshly cooked texture
+
+    bool is_compressed() const { return format == TextureFormat::BC1 || format == TextureFormat::BC3; }
+    /// GL internal format of the levels
+    GLenum gl_format() const;
+};
+
+/// Texture cut into square tiles of every mip level, so only the tiles in view need to be in GPU memory
+/// (streamed as a virtual texture). Tiles repeat a border of texels from their neighbours for filtering.
+struct TiledTexture {
+    static constexpr uint32_t kTileSize = 128; // texels per side, border included
+    static constexpr uint32_t kTileBorder = 4;
+    static constexpr uint32_t kTileContent = kTileSize - 2 * kTileBorder; // level texels per side
+
+    struct Level {
+        uint32_t width = 0, height = 0;
+        uint32_t tiles_x = 0, tiles_y = 0;
+        size_t first_tile = 0; // tiles are stored level by level, row by row
+    };
+    TextureFormat format = TextureFormat::RGBA8;
+    std::vector<Level> levels; // from the full size image down to the first level fitting in one tile
+    size_t tile_size = 0;      // bytes per tile
+    const uint8_t* tiles = nullptr;
+
+    Ref<FileView> file;           // cooked file the tiles are mapped from, when loaded from the cache
+    std::vector<uint8_t> storage; // tiles of a freshly cooked texture
+
+    size_t num_tiles() const { return levels.empty() ? 0 : levels.back().first_tile + size_t(levels.back().tiles_x) * levels.back().tiles_y; }
+    const uint8_t* tile(size_t index) const { return tiles + index * tile_size; }
+    bool is_compressed() const { return format == TextureFormat::BC1 || format == TextureFormat::BC3; }
+    /// GL internal format of the tiles
+    GLenum gl_format() const;
+};
+
+/// Build the mip chain of a decoded image (8-bit RGB or RGBA) with a box filter,
+/// block-compressed if the options say so
+CookedTexture cook_texture(const uint8_t* pixels, int width, int height, int channels, const TextureCookOptions& options);
+
+/// Load a texture from the texture cache, if present and up to date with its image file
+auto load_cooked_texture(std::string_view filepath, const TextureCookOptions& options) -> std::optional<CookedTexture>;
+
+/// Save a cooked texture in the texture cache, along with the version of its image file
+void save_cooked_texture(std::string_view filepath, const CookedTexture& texture, const TextureCookOptions& options);
+
+/// Cut the mip chain of a decoded image (8-bit RGB or RGBA) into tiles, block-compressed if the options say so
+TiledTexture cook_tiled_texture(const uint8_t* pixels, int width, int height, int channels, const TextureCookOptions& options);
+
+/// Load a tiled texture from the texture cache, if present and up to date with its image file
+auto load_tiled_texture(std::string_view filepath, const TextureCookOptions& options) -> std::optional<TiledTexture>;
+
+/// Save a tiled texture in the texture cache, along with the version of its image file
+void save_tiled_texture(std::string_view filepath, const TiledTexture& texture, const TextureCookOptions& options);
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// UPLOAD
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// IEEE 754 half precision float, storage only
+struct Half {
+    uint16_t bits;
+};
+
+/// Convert float to half float, rounding to nearest even
+Half float_to_half(float value);
+
+/// Convert half float to float (exact)
+float half_to_float(Half value);
+
+/// Vertex of the compressed mesh layout (VertexFormat::COMPRESSED)
+struct PackedVertex {
+    uint16_t position[4]; // unorm16 within the mesh bounds, w is padding to keep attributes 4-byte aligned
+    Half texcoord[2];
+    int16_t normal[2];    // snorm16 octahedral encoding
+};
+static_assert(sizeof(PackedVertex) == 16, "unexpected padding");
+
+/// Mesh vertices in its vertex format and indices of the narrowest type, ready for GPU buffers.
+/// Points into the mesh (or its cooked file) when no conversion is needed, so the mesh must outlive it.
+struct MeshUploadData {
+    const void* vertices = nullptr; // float or PackedVertex, by the mesh vertex format
+    size_t num_vertices = 0;
+    const void* indices = nullptr;
+    size_t num_indices = 0;
+    GLenum index_type = GL_UNSIGNED_INT;
+    glm::vec3 position_offset{ 0.f }; // decodes quantized positions: offset + position * scale
+    glm::vec3 position_scale{ 1.f };
+
+    std::vector<PackedVertex> packed_vertices; // storage of converted data
+    std::vector<unsigned short> indices16;
+};
+
+/// Convert a mesh vertices and indices to the layout uploaded to GPU buffers
+MeshUploadData prepare_mesh_upload(const Mesh& mesh);
+
+
+} // namespace sgl
@@ -0,0 +1,2269 @@
+#include "sgl_assets.hpp"
+
+#include <fstream>
+#include <filesystem>
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <climits>
+#include <cmath>
+#include <limits>
+#include <numeric>
+#include <thread>
+#include <tuple>
+
+#if defined(_WIN32)
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#if defined(__SSE4_1__) || defined(__AVX__)
+#define SGL_SIMD_SSE41
+#include <smmintrin.h>
+#endif
+
+#include <glm/gtc/type_ptr.hpp>
+
+/// Simple Graphics Library
+namespace sgl {
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// UTILS
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Read file contents to a string
+auto read_file_to_string(const std::string& filename) -> std::optional<std::string>
+{
+    std::string string;
+    std::fstream fstream(filename, std::ios::in | std::ios::binary);
+    if (!fstream) { ERROR("{} ({})", std::strerror(errno), filename); return std::nullopt; }
+    fstream.seekg(0, std::ios::end);
+    string.reserve(fstream.tellg());
+    fstream.seekg(0, std::ios::beg);
+    string.assign((std::istreambuf_iterator<char>(fstream)), std::istreambuf_iterator<char>());
+    return string;
+}
+
+FileView::~FileView()
+{
+    if (!mapped_)
+        return;
+#if defined(_WIN32)
+    UnmapViewOfFile(data_);
+#else
+    munmap(const_cast<char*>(data_), size_);
+#endif
+}
+
+FileView::FileView(FileView&& o)
+    : data_(o.data_), size_(o.size_), mapped_(o.mapped_), buffer_(std::move(o.buffer_))
+{
+    o.data_ = nullptr;
+    o.size_ = 0;
+    o.mapped_ = false;
+}
+
+FileView& FileView::operator=(FileView&& o)
+{
+    std::swap(data_, o.data_);
+    std::swap(size_, o.size_);
+    std::swap(mapped_, o.mapped_);
+    std::swap(buffer_, o.buffer_);
+    return *this;
+}
+
+/// Map a whole file into memory, returns nullptr if not possible
+static const char* map_file(const std::string& filename, size_t& size)
+{
+#if defined(_WIN32)
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER file_size;
+    HANDLE mapping = nullptr;
+    if (GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0)
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    void* addr = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    size = addr ? size_t(file_size.QuadPart) : 0;
+    return static_cast<const char*>(addr);
+#else
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    void* addr = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (addr == MAP_FAILED) return nullptr;
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    size = st.st_size;
+    return static_cast<const char*>(addr);
+#endif
+}
+
+/// Open a file and map its whole contents
+auto FileView::open(const std::string& filename) -> std::optional<FileView>
+{
+    FileView view;
+    if ((view.data_ = map_file(filename, view.size_))) {
+        view.mapped_ = true;
+        return view;
+    }
+
+    // Fallback to reading the file into memory
+    std::FILE* file = std::fopen(filename.c_str(), "rb");
+    if (!file) { ERROR("{} ({})", std::strerror(errno), filename); return std::nullopt; }
+#if defined(_WIN32)
+    struct _stat64 st;
+    const bool sized = (_fstat64(_fileno(file), &st) == 0);
+#else
+    struct stat st;
+    const bool sized = (fstat(fileno(file), &st) == 0);
+#endif
+    if (!sized) { ERROR("{} ({})", std::strerror(errno), filename); std::fclose(file); return std::nullopt; }
+    const size_t size = size_t(st.st_size);
+    view.buffer_ = std::make_unique<char[]>(size);
+    view.size_ = std::fread(view.buffer_.get(), 1, size, file); // less if the file shrank meanwhile
+    const bool failed = std::ferror(file);
+    std::fclose(file);
+    if (failed) { ERROR("Failed to read file ({})", filename); return std::nullopt; }
+    view.data_ = view.buffer_.get();
+    return view;
+}
+
+/// Powers of ten that are exact doubles
+static constexpr double kExactPow10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/// Convert `mantissa` / 10^`decimals` to the nearest float, the same as strtof does.
+/// Returns false when that can't be guaranteed without the general algorithm.
+static bool decimal_to_float(uint64_t mantissa, unsigned decimals, bool negative, float& value)
+{
+    if (mantissa > (uint64_t(1) << 53) || decimals >= std::size(kExactPow10))
+        return false;
+    // both operands are exact, so the quotient is correctly rounded to double
+    const double quotient = double(mantissa) / kExactPow10[decimals];
+    // rounding it again to float only differs from rounding straight to float when the
+    // double lands exactly halfway between two floats, and subnormals have less precision
+    uint64_t bits;
+    std::memcpy(&bits, &quotient, sizeof(bits));
+    if ((bits & 0x1FFFFFFF) == 0x10000000)
+        return false;
+    if (quotient != 0.0 && (quotient < std::numeric_limits<float>::min() || quotient > std::numeric_limits<float>::max()))
+        return false;
+    value = negative ? -float(quotient) : float(quotient);
+    return true;
+}
+
+/// Check if a number can end at this character
+static bool is_number_end(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+static unsigned count_trailing_zeros(uint32_t x)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    return _BitScanForward(&index, x) ? unsigned(index) : 32;
+#else
+    return x ? unsigned(__builtin_ctz(x)) : 32;
+#endif
+}
+
+#if defined(SGL_SIMD_SSE41)
+/// Parse a fixed-format decimal ([-]digits[.digits]) of up to 15 characters from a window of 16 bytes
+static const char* parse_fixed_float_sse41(const char* p, bool negative, float& value)
+{
+    const __m128i index = _mm_setr_epi8(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m128i chars = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i digits = _mm_sub_epi8(chars, _mm_set1_epi8('0'));
+    const __m128i is_digit = _mm_and_si128(_mm_cmpgt_epi8(digits, _mm_set1_epi8(-1)), _mm_cmplt_epi8(digits, _mm_set1_epi8(10)));
+    const uint32_t digit_mask = uint32_t(_mm_movemask_epi8(is_digit));
+
+    const unsigned int_digits = count_trailing_zeros(~digit_mask);
+    unsigned decimals = 0, length = int_digits;
+    __m128i packed = digits;
+    if (int_digits < 16 && p[int_digits] == '.') {
+        decimals = count_trailing_zeros(~(digit_mask >> (int_digits + 1)));
+        length = int_digits + 1 + decimals;
+        // move the integer digits one byte up, over the dot
+        const __m128i before_dot = _mm_cmpgt_epi8(_mm_set1_epi8(char(int_digits + 1)), index);
+        packed = _mm_blendv_epi8(digits, _mm_slli_si128(digits, 1), before_dot);
+    }
+    if (length >= 16 || int_digits + decimals == 0 || !is_number_end(p[length]))
+        return nullptr;
+
+    // right-align the digits with zeros in front, then combine them pairwise up to two 8-digit halves
+    const __m128i aligned = _mm_shuffle_epi8(packed, _mm_sub_epi8(index, _mm_set1_epi8(char(16 - length))));
+    const __m128i pairs = _mm_maddubs_epi16(aligned, _mm_setr_epi8(10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1, 10, 1));
+    const __m128i quads = _mm_madd_epi16(pairs, _mm_setr_epi16(100, 1, 100, 1, 100, 1, 100, 1));
+    const __m128i quads16 = _mm_packus_epi32(quads, quads);
+    const __m128i halves = _mm_madd_epi16(quads16, _mm_setr_epi16(10000, 1, 10000, 1, 10000, 1, 10000, 1));
+    const uint64_t mantissa = uint64_t(uint32_t(_mm_cvtsi128_si32(halves))) * 100000000 + uint32_t(_mm_extract_epi32(halves, 1));
+
+    if (!decimal_to_float(mantissa, decimals, negative, value))
+        return nullptr;
+    return p + length;
+}
+#endif
+
+/// Parse a fixed-format decimal ([-]digits[.digits]) such as the `%f` output of exporters
+const char* parse_fixed_float(const char* p, const char* end, float& value)
+{
+    const bool negative = (p < end && *p == '-');
+    p += negative;
+#if defined(SGL_SIMD_SSE41)
+    if (end - p >= 16)
+        return parse_fixed_float_sse41(p, negative, value);
+#endif
+    uint64_t mantissa = 0;
+    unsigned digits = 0, decimals = 0;
+    for (; p < end && unsigned(*p - '0') < 10; p++, digits++)
+        mantissa = mantissa * 10 + unsigned(*p - '0');
+    if (p < end && *p == '.') {
+        for (p++; p < end && unsigned(*p - '0') < 10; p++, decimals++)
+            mantissa = mantissa * 10 + unsigned(*p - '0');
+    }
+    if (digits + decimals == 0 || digits + decimals > 19 || (p < end && !is_number_end(*p)))
+        return nullptr;
+    if (!decimal_to_float(mantissa, decimals, negative, value))
+        return nullptr;
+    return p;
+}
+
+/// Pointer-based tokenizer over a contiguous text buffer, never allocates
+class TextScanner final {
+  public:
+    TextScanner(const char* begin, const char* end) : cur_(begin), end_(end) {}
+    explicit TextScanner(std::string_view text) : TextScanner(text.data(), text.data() + text.size()) {}
+
+    /// Check if the whole buffer was consumed
+    bool eof() const { return cur_ >= end_; }
+
+    /// Skip blanks (space, tab, carriage return) within the current line
+    void skip_blanks() {
+        while (cur_ < end_ && (*cur_ == ' ' || *cur_ == '\t' || *cur_ == '\r'))
+            cur_++;
+    }
+
+    /// Move to the beginning of the next line
+    void next_line() {
+        const void* nl = std::memchr(cur_, '\n', end_ - cur_);
+        cur_ = nl ? static_cast<const char*>(nl) + 1 : end_;
+    }
+
+    /// Read next blank-separated token from the current line (empty at end of line)
+    std::string_view token() {
+        skip_blanks();
+        const char* begin = cur_;
+        while (cur_ < end_ && !is_space(*cur_))
+            cur_++;
+        return { begin, size_t(cur_ - begin) };
+    }
+
+    /// Read the remaining of the current line without surrounding blanks
+    std::string_view rest_of_line() {
+        skip_blanks();
+        const char* begin = cur_;
+        while (cur_ < end_ && *cur_ != '\n')
+            cur_++;
+        const char* last = cur_;
+        while (last > begin && is_space(last[-1]))
+            last--;
+        return { begin, size_t(last - begin) };
+    }
+
+    /// Check if the rest of the current line is blank
+    bool end_of_line() {
+        skip_blanks();
+        return cur_ >= end_ || *cur_ == '\n';
+    }
+
+    /// Current read position, to return to with seek()
+    const char* position() const { return cur_; }
+    void seek(const char* pos) { cur_ = pos; }
+
+    /// Consume the given character if it's the next one
+    bool skip(char c) {
+        if (cur_ < end_ && *cur_ == c) { cur_++; return true; }
+        return false;
+    }
+
+    /// Parse next number from the current line, returns false if none
+    template<typename T>
+    bool number(T& value) {
+        skip_blanks();
+        auto [ptr, ec] = std::from_chars(cur_, end_, value);
+        if (ec != std::errc()) return false;
+        cur_ = ptr;
+        return true;
+    }
+
+    /// Parse next float from the current line, returns false if none
+    bool number(float& value) {
+        skip_blanks();
+        if (const char* ptr = parse_fixed_float(cur_, end_, value)) {
+            cur_ = ptr;
+            return true;
+        }
+        return number<float>(value);
+    }
+
+  private:
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\n'; }
+
+    const char* cur_;
+    const char* end_;
+};
+
+/// Bump allocator for the temporary data of one load operation.
+/// Allocations are carved out of large blocks and all released at once when the arena is destroyed.
+class Arena final {
+  public:
+    Arena() = default;
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    /// Allocate uninitialized memory, valid until the arena is destroyed
+    void* allocate(size_t size, size_t align) {
+        if (size > kBlockSize / 4) // large arrays get their own block, not to waste the current one
+            return blocks_.emplace_back(new std::byte[size]).get();
+        size_t pad = (align - (uintptr_t(cur_) & (align - 1))) & (align - 1);
+        if (pad + size > left_) {
+            cur_ = blocks_.emplace_back(new std::byte[kBlockSize]).get();
+            left_ = kBlockSize;
+            pad = 0;
+        }
+        void* ptr = cur_ + pad;
+        cur_ += pad + size;
+        left_ -= pad + size;
+        return ptr;
+    }
+
+    template<typename T>
+    T* allocate(size_t count) { return static_cast<T*>(allocate(count * sizeof(T), alignof(T))); }
+
+  private:
+    static constexpr size_t kBlockSize = 64 * 1024;
+
+    std::vector<std::unique_ptr<std::byte[]>> blocks_;
+    std::byte* cur_ = nullptr;
+    size_t left_ = 0;
+};
+
+/// Standard allocator over an Arena, deallocation is a no-op
+template<typename T>
+struct ArenaAllocator {
+    using value_type = T;
+    Arena* arena;
+
+    explicit ArenaAllocator(Arena& arena) : arena(&arena) {}
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t count) { return arena->allocate<T>(count); }
+    void deallocate(T*, size_t) {}
+
+    template<typename U> bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template<typename U> bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+template<typename T>
+using ArenaVector = std::vector<T, ArenaAllocator<T>>;
+
+/// Size in bytes of a GL index type
+size_t index_type_size(GLenum type)
+{
+    switch (type) {
+        case GL_UNSIGNED_BYTE: return sizeof(GLubyte);
+        case GL_UNSIGNED_SHORT: return sizeof(GLushort);
+        default: return sizeof(GLuint);
+    }
+}
+
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MESH/MODEL
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Load every Material from a MTL file (textures are left for the caller to load)
+auto load_mtl(const std::string& filename) -> std::optional<std::vector<MaterialRef>>
+{
+    const auto file = FileView::open(filename);
+    if (!file) {
+        ERROR("Error opening MTL file '{}'", filename);
+        return std::nullopt;
+    }
+
+    std::vector<MaterialRef> materials;
+    Material dummy{}; // receives statements found before the first 'newmtl'
+    Material* material = &dummy;
+    for (TextScanner scan(file->str()); !scan.eof(); scan.next_line()) {
+        const std::string_view code = scan.token();
+        if (code == "newmtl") {
+            materials.push_back(std::make_shared<Material>());
+            material = materials.back().get();
+            material->name = scan.rest_of_line();
+        }
+        else if (code == "map_Kd") {
+            const std::string_view texture = scan.rest_of_line();
+            material->diffuse_map = std::filesystem::path(filename).remove_filename().append(texture).string();
+        }
+        else if (code == "Ns") {
+            scan.number(material->q);
+        }
+        else if (code == "Ka") {
+            scan.number(material->ka);
+        }
+        else if (code == "Kd") {
+            scan.number(material->kd);
+        }
+        else if (code == "Ks") {
+            scan.number(material->ks);
+        }
+    }
+
+    return materials;
+}
+
+/// Cooked mesh file layout:
+///   MeshCacheHeader | vertex blob | index blob | tables (sources, materials, submeshes)
+/// Blobs are aligned so they can be uploaded straight from the file mapping.
+struct MeshCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint64_t num_vertices;
+    uint64_t num_indices;
+    uint32_t index_type;
+    uint32_t floats_per_vertex;
+    uint64_t flags; // MeshCacheFlags the mesh was cooked with
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t table_offset;
+    uint64_t file_size;
+};
+
+static constexpr char kMeshCacheMagic[4] = { 'S', 'G', 'L', 'M' };
+static constexpr uint32_t kMeshCacheVersion = 4;
+static constexpr size_t kMeshCacheAlign = 64;
+static constexpr uint32_t kNoMaterial = UINT32_MAX;
+
+/// Processing applied to a cooked mesh, a cache cooked with other options is not reused
+enum MeshCacheFlags : uint64_t {
+    MESH_CACHE_OPTIMIZED = 1 << 0,   // triangle and vertex order optimized
+    MESH_CACHE_LOD_LEVELS_SHIFT = 8, // bits 8-15: number of LOD levels requested
+    MESH_CACHE_LOD_ERROR_SHIFT = 32, // bits 32-63: LOD error limit (float bits)
+};
+
+static uint64_t mesh_cache_flags(const ModelLoadOptions& options)
+{
+    uint32_t lod_error;
+    std::memcpy(&lod_error, &options.lod_error, sizeof(lod_error));
+    return (options.optimize ? uint64_t(MESH_CACHE_OPTIMIZED) : uint64_t(0))
+        | (uint64_t(std::min(options.lod_levels, 0xffu)) << MESH_CACHE_LOD_LEVELS_SHIFT)
+        | (options.lod_levels ? uint64_t(lod_error) << MESH_CACHE_LOD_ERROR_SHIFT : 0);
+}
+
+/// Append-only buffer for writing binary files
+class BinaryWriter final {
+  public:
+    template<typename T>
+    void put(const T& value) { put_bytes(&value, sizeof(T)); }
+    void put_bytes(const void* data, size_t size) { buf_.append(static_cast<const char*>(data), size); }
+    void put_str(std::string_view str) { put<uint32_t>(str.size()); put_bytes(str.data(), str.size()); }
+    void align(size_t alignment) { buf_.resize((buf_.size() + alignment - 1) / alignment * alignment); }
+    size_t size() const { return buf_.size(); }
+    std::string& buffer() { return buf_; }
+  private:
+    std::string buf_;
+};
+
+/// Bounds-checked reader over a binary buffer, reads zeroes once out of bounds
+class BinaryReader final {
+  public:
+    BinaryReader(const char* begin, const char* end) : cur_(begin), end_(end) {}
+    template<typename T>
+    T get() {
+        T value{};
+        if (size_t(end_ - cur_) < sizeof(T)) { ok_ = false; return value; }
+        std::memcpy(&value, cur_, sizeof(T));
+        cur_ += sizeof(T);
+        return value;
+    }
+    std::string_view get_str() {
+        const auto len = get<uint32_t>();
+        if (size_t(end_ - cur_) < len) { ok_ = false; return {}; }
+        cur_ += len;
+        return { cur_ - len, len };
+    }
+    bool ok() const { return ok_; }
+  private:
+    const char* cur_;
+    const char* end_;
+    bool ok_ = true;
+};
+
+/// Identity of a source file version, changes whenever the file is modified
+static auto source_stamp(const std::string& path) -> std::optional<std::pair<int64_t, uint64_t>>
+{
+    std::error_code ec;
+    const auto mtime = std::filesystem::last_write_time(path, ec);
+    if (ec) return std::nullopt;
+    const auto size = std::filesystem::file_size(path, ec);
+    if (ec) return std::nullopt;
+    return std::make_pair(int64_t(mtime.time_since_epoch().count()), uint64_t(size));
+}
+
+/// Path of the cooked file for a source file, `extension` tells the kind of cooked file
+static std::string cache_file_path(std::string_view filepath, const std::string& cache_dir, const char* extension)
+{
+    const std::filesystem::path source(filepath);
+    if (cache_dir.empty())
+        return source.string() + extension;
+    // tell apart files with the same name from different directories
+    std::error_code ec;
+    const size_t hash = std::hash<std::string>{}(std::filesystem::absolute(source, ec).string());
+    char name[32];
+    std::snprintf(name, sizeof(name), "-%016zx", hash);
+    return (std::filesystem::path(cache_dir) / source.stem()).string() + name + extension;
+}
+
+/// Path of the cooked mesh file for a model source file
+static std::string mesh_cache_path(std::string_view filepath, const ModelLoadOptions& options)
+{
+    return cache_file_path(filepath, options.cache_dir, ".sglmesh");
+}
+
+/// Write a cooked file, through a temporary file so a partially written one is never picked up
+static bool write_cache_file(const std::string& cache_path, const std::string& contents)
+{
+    const std::string tmp_path = cache_path + ".tmp";
+    std::error_code ec;
+    if (auto dir = std::filesystem::path(cache_path).parent_path(); !dir.empty())
+        std::filesystem::create_directories(dir, ec);
+    std::FILE* file = std::fopen(tmp_path.c_str(), "wb");
+    if (!file) { WARN("Failed to write cache file {}: {}", tmp_path, std::strerror(errno)); return false; }
+    const bool written = std::fwrite(contents.data(), 1, contents.size(), file) == contents.size();
+    const bool closed = std::fclose(file) == 0;
+    if (!written || !closed) {
+        WARN("Failed to write cache file {}", tmp_path);
+        std::filesystem::remove(tmp_path, ec);
+        return false;
+    }
+    std::filesystem::rename(tmp_path, cache_path, ec);
+    if (ec) { WARN("Failed to write cache file {}: {}", cache_path, ec.message()); return false; }
+    return true;
+}
+
+/// Write the version of a source file the cooked data is built from
+static bool put_source_stamp(BinaryWriter& out, const std::string& source)
+{
+    const auto stamp = source_stamp(source);
+    if (!stamp)
+        return false;
+    std::error_code ec;
+    out.put_str(std::filesystem::absolute(source, ec).lexically_normal().string());
+    out.put(stamp->first);
+    out.put(stamp->second);
+    return true;
+}
+
+/// Save a parsed model to a cooked mesh file, along with the source files it depends on
+static void save_cooked_model(const std::string& cache_path, const Model& model, uint64_t flags)
+{
+    const Mesh& mesh = model.mesh;
+    const GLenum index_type = mesh.index_type();
+    BinaryWriter out;
+
+    MeshCacheHeader header{};
+    std::memcpy(header.magic, kMeshCacheMagic, sizeof(header.magic));
+    header.version = kMeshCacheVersion;
+    header.num_vertices = mesh.num_vertices();
+    header.num_indices = mesh.indices.size();
+    header.index_type = index_type;
+    header.floats_per_vertex = Mesh::kFloatsPerVertex;
+    header.flags = flags;
+    out.put(header);
+
+    out.align(kMeshCacheAlign);
+    header.vertex_offset = out.size();
+    out.put_bytes(mesh.vertices.data(), mesh.vertices.size() * sizeof(float));
+
+    out.align(kMeshCacheAlign);
+    header.index_offset = out.size();
+    if (index_type == GL_UNSIGNED_SHORT) {
+        for (unsigned int index : mesh.indices)
+            out.put<uint16_t>(index);
+    } else {
+        out.put_bytes(mesh.indices.data(), mesh.indices.size() * sizeof(unsigned int));
+    }
+
+    out.align(kMeshCacheAlign);
+    header.table_offset = out.size();
+    out.put<uint32_t>(model.sources.size());
+    for (const std::string& source : model.sources) {
+        if (!put_source_stamp(out, source)) { WARN("Failed to stat {}, not caching mesh", source); return; }
+    }
+    out.put<uint32_t>(model.materials.size());
+    for (const MaterialRef& material : model.materials) {
+        out.put_str(material->name);
+        out.put(material->ka);
+        out.put(material->kd);
+        out.put(material->ks);
+        out.put(material->q);
+        out.put_str(material->diffuse_map);
+    }
+    const auto put_submeshes = [&](const std::vector<SubMesh>& submeshes) {
+        out.put<uint32_t>(submeshes.size());
+        for (const SubMesh& submesh : submeshes) {
+            auto it = std::find(model.materials.begin(), model.materials.end(), submesh.material);
+            out.put<uint64_t>(submesh.index_offset);
+            out.put<uint64_t>(submesh.index_count);
+            out.put<uint32_t>(it != model.materials.end() ? uint32_t(it - model.materials.begin()) : kNoMaterial);
+        }
+    };
+    put_submeshes(mesh.submeshes);
+    out.put<uint32_t>(mesh.lods.size());
+    for (const MeshLod& lod : mesh.lods) {
+        out.put(lod.error);
+        put_submeshes(lod.submeshes);
+    }
+    out.put(mesh.center);
+    out.put(mesh.radius);
+
+    header.file_size = out.size();
+    std::memcpy(out.buffer().data(), &header, sizeof(header));
+
+    if (!write_cache_file(cache_path, out.buffer()))
+        return;
+    DEBUG("Saved mesh cache {} ({} bytes)", cache_path, out.size());
+}
+
+/// Load a model from its cooked mesh file, returns null if missing or out of date
+static ModelRef load_cooked_model(const std::string& cache_path, uint64_t flags)
+{
+    std::error_code ec;
+    if (!std::filesystem::exists(cache_path, ec))
+        return nullptr;
+    auto file = FileView::open(cache_path);
+    if (!file || file->size() < sizeof(MeshCacheHeader))
+        return nullptr;
+
+    MeshCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    const bool valid_header = std::memcmp(header.magic, kMeshCacheMagic, sizeof(header.magic)) == 0
+        && header.version == kMeshCacheVersion
+        && header.floats_per_vertex == Mesh::kFloatsPerVertex
+        && header.flags == flags
+        && header.file_size == file->size()
+        && (header.index_type == GL_UNSIGNED_SHORT || header.index_type == GL_UNSIGNED_INT)
+        && header.vertex_offset + header.num_vertices * Mesh::kFloatsPerVertex * sizeof(float) <= header.index_offset
+        && header.index_offset + header.num_indices * index_type_size(header.index_type) <= header.table_offset
+        && header.table_offset <= file->size();
+    if (!valid_header) {
+        WARN("Invalid mesh cache {}, ignoring it", cache_path);
+        return nullptr;
+    }
+
+    Model model;
+    BinaryReader in(file->data() + header.table_offset, file->data() + file->size());
+    for (uint32_t n = in.get<uint32_t>(); n > 0 && in.ok(); n--) {
+        const std::string& source = model.sources.emplace_back(in.get_str());
+        const auto mtime = in.get<int64_t>();
+        const auto size = in.get<uint64_t>();
+        if (source_stamp(source) != std::make_pair(mtime, size)) {
+            DEBUG("Mesh cache {} is out of date with {}", cache_path, source);
+            return nullptr;
+        }
+    }
+
+    bool valid_ranges = true;
+    for (uint32_t n = in.get<uint32_t>(); n > 0 && in.ok(); n--) {
+        Material material;
+        material.name = in.get_str();
+        material.ka = in.get<float>();
+        material.kd = in.get<float>();
+        material.ks = in.get<float>();
+        material.q = in.get<float>();
+        material.diffuse_map = in.get_str();
+        model.materials.push_back(material.to_ref());
+    }
+    const auto get_submeshes = [&](std::vector<SubMesh>& submeshes) {
+        for (uint32_t n = in.get<uint32_t>(); n > 0 && in.ok(); n--) {
+            SubMesh& submesh = submeshes.emplace_back();
+            submesh.index_offset = in.get<uint64_t>();
+            submesh.index_count = in.get<uint64_t>();
+            const auto material = in.get<uint32_t>();
+            if (material < model.materials.size())
+                submesh.material = model.materials[material];
+            valid_ranges &= submesh.index_offset + submesh.index_count <= header.num_indices;
+        }
+    };
+    get_submeshes(model.mesh.submeshes);
+    for (uint32_t n = in.get<uint32_t>(); n > 0 && in.ok(); n--) {
+        MeshLod& lod = model.mesh.lods.emplace_back();
+        lod.error = in.get<float>();
+        get_submeshes(lod.submeshes);
+    }
+    model.mesh.center = in.get<glm::vec3>();
+    model.mesh.radius = in.get<float>();
+    if (!in.ok() || !valid_ranges) {
+        WARN("Corrupted mesh cache {}, ignoring it", cache_path);
+        return nullptr;
+    }
+
+    auto& cooked = model.mesh.cooked.emplace();
+    cooked.vertices = reinterpret_cast<const float*>(file->data() + header.vertex_offset);
+    cooked.num_vertices = header.num_vertices;
+    cooked.indices = file->data() + header.index_offset;
+    cooked.num_indices = header.num_indices;
+    cooked.index_type = header.index_type;
+    cooked.file = std::make_shared<FileView>(std::move(*file));
+    return std::make_shared<Model>(std::move(model));
+}
+
+/// Hash table mapping OBJ (v, vt, vn) index triplets to unique vertex indices.
+/// Open addressing with linear probing over a fixed capacity taken from the arena, so it never rehashes.
+class VertexIndexTable final {
+  public:
+    using Key = glm::u32vec3;
+
+    /// Table for up to `max_keys` keys
+    VertexIndexTable(Arena& arena, size_t max_keys) {
+        size_t capacity = 64;
+        while (capacity < max_keys + max_keys / 2)
+            capacity *= 2;
+        slots_ = arena.allocate<Slot>(capacity);
+        std::uninitialized_fill_n(slots_, capacity, Slot{});
+        mask_ = capacity - 1;
+    }
+
+    /// Find the vertex index for the given key, or insert it as `next` if not present.
+    /// Returns the index and whether it was inserted.
+    std::pair<uint32_t, bool> insert(Key key, uint32_t next) {
+        for (size_t i = hash(key) & mask_; ; i = (i + 1) & mask_) {
+            Slot& slot = slots_[i];
+            if (slot.index == kEmpty) {
+                slot = { key, next };
+                return { next, true };
+            }
+            if (slot.key == key)
+                return { slot.index, false };
+        }
+    }
+
+  private:
+    static constexpr uint32_t kEmpty = UINT32_MAX;
+    struct Slot { Key key; uint32_t index = kEmpty; };
+
+    static size_t hash(Key k) {
+        uint64_t h = (uint64_t(k.x) * 0x9E3779B97F4A7C15ull) ^ (uint64_t(k.y) * 0xC2B2AE3D27D4EB4Full) ^ (uint64_t(k.z) * 0x165667B19E3779F9ull);
+        return size_t(h ^ (h >> 29));
+    }
+
+    Slot* slots_;
+    size_t mask_;
+};
+
+/// Number of records in a range of lines of an OBJ file
+struct ObjCounts {
+    size_t positions = 0;
+    size_t normals = 0;
+    size_t texcoords = 0;
+    size_t corners = 0; // after triangulation, 3 per triangle
+    size_t statements = 0;
+};
+
+/// Records parsed from a range of lines of an OBJ file.
+/// Vertex attributes are written straight to the chunk's slice of the model arrays, sized by a counting pass.
+struct ObjChunk {
+    /// Statements that must be applied in file order relative to the face corners
+    struct Statement {
+        size_t corner; // number of corners parsed before this statement
+        std::string_view code;
+        std::string_view arg;
+    };
+
+    Arena arena; // corners and statements, filled by the chunk's own thread
+    std::string_view text;
+    ObjCounts counts;
+    glm::u32vec3 base{ 0u }; // (v, vt, vn) records in the chunks before, to resolve negative indices
+    glm::vec3* positions = nullptr;
+    glm::vec2* texcoords = nullptr;
+    glm::vec3* normals = nullptr;
+    glm::u32vec3 parsed{ 0u }; // (v, vt, vn) records parsed so far
+    ArenaVector<glm::u32vec3> corners{ ArenaAllocator<glm::u32vec3>(arena) }; // face corners as (v, vt, vn) file indices (0 if absent)
+    ArenaVector<Statement> statements{ ArenaAllocator<Statement>(arena) };
+};
+
+/// Count the records of a range of lines of an OBJ file, to size the arrays before parsing it
+static ObjCounts count_obj_records(std::string_view text)
+{
+    ObjCounts counts;
+    for (TextScanner scan(text); !scan.eof(); scan.next_line()) {
+        const std::string_view code = scan.token();
+        if (code == "v") {
+            counts.positions++;
+        }
+        else if (code == "vn") {
+            counts.normals++;
+        }
+        else if (code == "vt") {
+            counts.texcoords++;
+        }
+        else if (code == "f") {
+            size_t n = 0;
+            while (!scan.token().empty())
+                n++;
+            counts.corners += (n >= 3) ? (n - 2) * 3 : 0;
+        }
+        else if (code == "usemtl" || code == "mtllib") {
+            counts.statements++;
+        }
+    }
+    return counts;
+}
+
+/// Parse a face that is a triangle with three v/vt/vn positive indices, the common case.
+/// Returns false, with nothing consumed, for any other face.
+static bool parse_obj_triangle(TextScanner& scan, ObjChunk& chunk)
+{
+    const char* start = scan.position();
+    glm::u32vec3 c[3];
+    for (glm::u32vec3& corner : c) {
+        if (!(scan.number(corner[0]) && scan.skip('/') && scan.number(corner[1]) && scan.skip('/') && scan.number(corner[2]))) {
+            scan.seek(start);
+            return false;
+        }
+    }
+    if (!scan.end_of_line()) {
+        scan.seek(start);
+        return false;
+    }
+    chunk.corners.insert(chunk.corners.end(), std::begin(c), std::end(c));
+    return true;
+}
+
+/// Parse a face of any number of corners as a triangle fan. Corners may be v, v/vt, v//vn or v/vt/vn,
+/// with negative indices counting back from the last record.
+static void parse_obj_polygon(TextScanner& scan, ObjChunk& chunk)
+{
+    const glm::u32vec3 counts = chunk.base + chunk.parsed;
+    const auto parse_corner = [&](glm::u32vec3& corner) {
+        for (int attr = 0; attr < 3; attr++) {
+            if (attr > 0 && !scan.skip('/'))
+                break;
+            int32_t value;
+            if (!scan.number(value)) {
+                if (attr == 0)
+                    return false;
+                continue;
+            }
+            corner[attr] = (value < 0) ? counts[attr] + uint32_t(value) + 1 : uint32_t(value);
+        }
+        return true;
+    };
+
+    glm::u32vec3 first, prev;
+    for (size_t n = 0;; n++) {
+        glm::u32vec3 corner(0u);
+        if (!parse_corner(corner))
+            break;
+        if (n >= 2)
+            chunk.corners.insert(chunk.corners.end(), { first, prev, corner });
+        (n == 0 ? first : prev) = corner;
+    }
+}
+
+/// Parse vertex attributes, faces and statements from a range of lines of an OBJ file
+static void parse_obj_chunk(ObjChunk& chunk)
+{
+    chunk.corners.reserve(chunk.counts.corners);
+    chunk.statements.reserve(chunk.counts.statements);
+    bool triangles_only = true; // until a face needs the general parser
+    for (TextScanner scan(chunk.text); !scan.eof(); scan.next_line()) {
+        const std::string_view code = scan.token();
+        if (code == "v") {
+            glm::vec3& v = chunk.positions[chunk.parsed[0]++] = glm::vec3(0.f);
+            scan.number(v.x); scan.number(v.y); scan.number(v.z);
+        }
+        else if (code == "vn") {
+            glm::vec3& vn = chunk.normals[chunk.parsed[2]++] = glm::vec3(0.f);
+            scan.number(vn.x); scan.number(vn.y); scan.number(vn.z);
+        }
+        else if (code == "vt") {
+            glm::vec2& vt = chunk.texcoords[chunk.parsed[1]++] = glm::vec2(0.f);
+            scan.number(vt.x); scan.number(vt.y);
+        }
+        else if (code == "f") {
+            if (!triangles_only || !parse_obj_triangle(scan, chunk)) {
+                triangles_only = false;
+                parse_obj_polygon(scan, chunk);
+            }
+        }
+        else if (code == "usemtl" || code == "mtllib") {
+            chunk.statements.push_back({ chunk.corners.size(), code, scan.rest_of_line() });
+        }
+    }
+}
+
+/// Split text in up to `count` pieces of similar size, at line boundaries
+static auto split_lines(std::string_view text, size_t count) -> std::vector<std::string_view>
+{
+    std::vector<std::string_view> pieces;
+    size_t begin = 0;
+    for (size_t i = 1; i <= count && begin < text.size(); i++) {
+        size_t end = (i == count) ? text.size() : std::max(begin, text.size() * i / count);
+        end = std::min(text.find('\n', end), text.size() - 1) + 1;
+        pieces.push_back(text.substr(begin, end - begin));
+        begin = end;
+    }
+    return pieces;
+}
+
+/// Run `fn(i)` for each i in [0, count) on its own thread, the calling thread takes the first one
+template<typename Fn>
+static void parallel_for_each(size_t count, const Fn& fn)
+{
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < count; i++)
+        workers.emplace_back(fn, i);
+    if (count > 0)
+        fn(size_t(0));
+    for (auto& worker : workers)
+        worker.join();
+}
+
+/// Average cache miss ratio: vertices transformed per triangle, simulating a FIFO post-transform cache
+static float average_cache_miss_ratio(const unsigned int* indices, size_t num_indices, size_t num_vertices, size_t cache_size = 16)
+{
+    constexpr size_t kNever = SIZE_MAX;
+    std::vector<size_t> loaded_at(num_vertices, kNever); // miss count when the vertex entered the cache
+    size_t misses = 0;
+    for (size_t i = 0; i < num_indices; i++) {
+        const unsigned int index = indices[i];
+        if (loaded_at[index] == kNever || misses - loaded_at[index] >= cache_size)
+            loaded_at[index] = misses++;
+    }
+    return num_indices ? float(misses) / float(num_indices / 3) : 0.f;
+}
+
+/// Reorder the triangles of an index range for post-transform vertex cache hits, using
+/// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+static void optimize_vertex_cache(unsigned int* indices, size_t num_indices, size_t num_vertices)
+{
+    constexpr int kCacheSize = 32;
+    const size_t num_triangles = num_indices / 3;
+    if (num_triangles < 2)
+        return;
+
+    // favors vertices recently used and vertices with few triangles left, so they can leave the cache
+    const auto vertex_score = [](int cache_pos, unsigned int remaining) -> float {
+        if (remaining == 0)
+            return -1.f;
+        float score = 0.f;
+        if (cache_pos >= 0) {
+            score = (cache_pos < 3) ? 0.75f // in the last triangle
+                : std::pow(1.f - float(cache_pos - 3) / float(kCacheSize - 3), 1.5f);
+        }
+        return score + 2.f * std::pow(float(remaining), -0.5f);
+    };
+
+    // triangles not emitted yet of each vertex, the first `remaining[v]` of its list
+    std::vector<unsigned int> remaining(num_vertices, 0);
+    for (size_t i = 0; i < num_triangles * 3; i++)
+        remaining[indices[i]]++;
+    std::vector<unsigned int> first(num_vertices + 1, 0);
+    for (size_t v = 0; v < num_vertices; v++)
+        first[v + 1] = first[v] + remaining[v];
+    std::vector<unsigned int> vertex_triangles(num_triangles * 3);
+    {
+        std::vector<unsigned int> fill(first.begin(), first.end() - 1);
+        for (size_t i = 0; i < num_triangles * 3; i++)
+            vertex_triangles[fill[indices[i]]++] = unsigned(i / 3);
+    }
+
+    std::vector<int> cache_pos(num_vertices, -1);
+    std::vector<float> score(num_vertices);
+    for (size_t v = 0; v < num_vertices; v++)
+        score[v] = vertex_score(-1, remaining[v]);
+    std::vector<float> triangle_score(num_triangles);
+    for (size_t t = 0; t < num_triangles; t++)
+        triangle_score[t] = score[indices[t*3]] + score[indices[t*3+1]] + score[indices[t*3+2]];
+    std::vector<bool> emitted(num_triangles, false);
+
+    std::vector<unsigned int> output;
+    output.reserve(num_triangles * 3);
+    std::vector<unsigned int> cache, new_cache;
+    size_t next_unemitted = 0; // when no cached vertex has triangles left
+    size_t best = std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin();
+    while (true) {
+        emitted[best] = true;
+        const unsigned int* triangle = &indices[best * 3];
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // most recent vertices go to the front of the cache
+        new_cache.clear();
+        for (int k = 0; k < 3; k++) {
+            const unsigned int v = triangle[k];
+            auto begin = vertex_triangles.begin() + first[v], end = begin + remaining[v];
+            std::iter_swap(std::find(begin, end, unsigned(best)), end - 1);
+            remaining[v]--;
+            if (std::find(new_cache.begin(), new_cache.end(), v) == new_cache.end())
+                new_cache.push_back(v);
+        }
+        const size_t num_triangle_vertices = new_cache.size();
+        for (unsigned int v : cache) {
+            const auto triangle_end = new_cache.begin() + num_triangle_vertices;
+            if (std::find(new_cache.begin(), triangle_end, v) == triangle_end)
+                new_cache.push_back(v);
+        }
+
+        // rescore the cache vertices (and the ones just evicted) and their triangles
+        float best_score = -1.f;
+        bool found = false;
+        for (size_t i = 0; i < new_cache.size(); i++) {
+            const unsigned int v = new_cache[i];
+            cache_pos[v] = (i < kCacheSize) ? int(i) : -1;
+            const float new_score = vertex_score(cache_pos[v], remaining[v]);
+            const float delta = new_score - score[v];
+            score[v] = new_score;
+            for (unsigned int j = first[v]; j < first[v] + remaining[v]; j++)
+                triangle_score[vertex_triangles[j]] += delta;
+        }
+        if (new_cache.size() > kCacheSize)
+            new_cache.resize(kCacheSize);
+        for (unsigned int v : new_cache) {
+            for (unsigned int j = first[v]; j < first[v] + remaining[v]; j++) {
+                const unsigned int t = vertex_triangles[j];
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                    found = true;
+                }
+            }
+        }
+        std::swap(cache, new_cache);
+
+        if (!found) {
+            while (next_unemitted < num_triangles && emitted[next_unemitted])
+                next_unemitted++;
+            if (next_unemitted == num_triangles)
+                break;
+            best = next_unemitted;
+        }
+    }
+    std::copy(output.begin(), output.end(), indices);
+}
+
+/// Renumber vertices in the order the index buffer first uses them, so vertex fetches walk memory forward
+static void optimize_vertex_fetch(Mesh& mesh)
+{
+    constexpr unsigned int kUnused = UINT_MAX;
+    const size_t num_vertices = mesh.num_vertices();
+    std::vector<unsigned int> remap(num_vertices, kUnused);
+    unsigned int next = 0;
+    for (unsigned int& index : mesh.indices) {
+        if (remap[index] == kUnused)
+            remap[index] = next++;
+        index = remap[index];
+    }
+    std::vector<float> vertices(mesh.vertices.size());
+    for (size_t v = 0; v < num_vertices; v++) {
+        if (remap[v] == kUnused)
+            remap[v] = next++; // unreferenced vertices go last
+        std::copy_n(&mesh.vertices[v * Mesh::kFloatsPerVertex], Mesh::kFloatsPerVertex, &vertices[remap[v] * Mesh::kFloatsPerVertex]);
+    }
+    mesh.vertices.swap(vertices);
+}
+
+/// Optimize triangle order of every submesh (and LOD) for the vertex cache, then vertex order for fetching
+static void optimize_mesh(Mesh& mesh, std::string_view name)
+{
+    // full detail submeshes are at the start of the index buffer
+    size_t full_detail_indices = 0;
+    for (const SubMesh& submesh : mesh.submeshes)
+        full_detail_indices = std::max(full_detail_indices, submesh.index_offset + submesh.index_count);
+    const float acmr_before = average_cache_miss_ratio(mesh.indices.data(), full_detail_indices, mesh.num_vertices());
+    for (const SubMesh& submesh : mesh.submeshes)
+        optimize_vertex_cache(&mesh.indices[submesh.index_offset], submesh.index_count, mesh.num_vertices());
+    for (const MeshLod& lod : mesh.lods) {
+        for (const SubMesh& submesh : lod.submeshes)
+            optimize_vertex_cache(&mesh.indices[submesh.index_offset], submesh.index_count, mesh.num_vertices());
+    }
+    optimize_vertex_fetch(mesh);
+    const float acmr_after = average_cache_miss_ratio(mesh.indices.data(), full_detail_indices, mesh.num_vertices());
+    DEBUG("Optimized mesh {}: ACMR {:.3f} -> {:.3f}", name, acmr_before, acmr_after);
+}
+
+/// Bounding sphere of the mesh vertices, centered in their bounding box
+static void compute_bounds(Mesh& mesh)
+{
+    const size_t num_vertices = mesh.num_vertices();
+    if (num_vertices == 0)
+        return;
+    glm::vec3 min(std::numeric_limits<float>::max()), max(std::numeric_limits<float>::lowest());
+    for (size_t v = 0; v < num_vertices; v++) {
+        const glm::vec3 position = glm::make_vec3(&mesh.vertices[v * Mesh::kFloatsPerVertex]);
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    mesh.center = (min + max) * 0.5f;
+    mesh.radius = 0.f;
+    for (size_t v = 0; v < num_vertices; v++)
+        mesh.radius = std::max(mesh.radius, glm::distance(mesh.center, glm::make_vec3(&mesh.vertices[v * Mesh::kFloatsPerVertex])));
+}
+
+/// Sum of squared distances to a set of planes, weighted by the area of the triangles they came from
+struct Quadric {
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0, c = 0;
+    double weight = 0;
+
+    /// Add the plane dot(n, p) + d = 0
+    void add_plane(glm::dvec3 n, double d, double w) {
+        a00 += w * n.x * n.x; a01 += w * n.x * n.y; a02 += w * n.x * n.z;
+        a11 += w * n.y * n.y; a12 += w * n.y * n.z; a22 += w * n.z * n.z;
+        b0 += w * n.x * d; b1 += w * n.y * d; b2 += w * n.z * d;
+        c += w * d * d;
+        weight += w;
+    }
+
+    Quadric& operator+=(const Quadric& o) {
+        a00 += o.a00; a01 += o.a01; a02 += o.a02; a11 += o.a11; a12 += o.a12; a22 += o.a22;
+        b0 += o.b0; b1 += o.b1; b2 += o.b2; c += o.c;
+        weight += o.weight;
+        return *this;
+    }
+
+    /// Weighted sum of squared distances from point p to the planes
+    double eval(glm::dvec3 p) const {
+        const double e = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z
+            + 2 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z)
+            + 2 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return std::max(e, 0.0);
+    }
+};
+
+/// Index list of a simplified mesh level
+struct SimplifiedLevel {
+    std::vector<unsigned int> indices;
+    float error = 0.f;
+};
+
+/// Simplify a triangle list by collapsing vertices onto their neighbors, driven by quadric error.
+/// Vertices only move onto existing ones, so the result indexes the same vertex buffer.
+/// Vertices on borders and attribute seams (`locked`) stay in place to keep the mesh outline and
+/// texture mapping intact. Each level halves the triangles of the previous one, stopping at `max_error`.
+static auto simplify_triangles(const Mesh& mesh, const std::vector<bool>& locked, const unsigned int* begin, size_t count,
+                               size_t levels, float max_error) -> std::vector<SimplifiedLevel>
+{
+    const size_t num_vertices = mesh.num_vertices();
+    const auto position = [&](unsigned int v) { return glm::make_vec3(&mesh.vertices[v * Mesh::kFloatsPerVertex]); };
+    std::vector<unsigned int> indices(begin, begin + count);
+
+    std::vector<Quadric> quadrics(num_vertices);
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const glm::dvec3 p0 = position(indices[i]), p1 = position(indices[i+1]), p2 = position(indices[i+2]);
+        glm::dvec3 normal = glm::cross(p1 - p0, p2 - p0);
+        const double area2 = glm::length(normal);
+        if (area2 == 0.0)
+            continue;
+        normal /= area2;
+        for (int k = 0; k < 3; k++)
+            quadrics[indices[i+k]].add_plane(normal, -glm::dot(normal, p0), area2 * 0.5);
+    }
+    const auto collapse_cost = [&](unsigned int from, unsigned int to) {
+        const glm::dvec3 p = position(to);
+        const double weight = quadrics[from].weight + quadrics[to].weight;
+        return weight > 0 ? (quadrics[from].eval(p) + quadrics[to].eval(p)) / weight : 0.0;
+    };
+
+    struct Collapse {
+        unsigned int from, to;
+        double cost;
+    };
+    std::vector<Collapse> collapses;
+    std::vector<unsigned int> first(num_vertices + 1), vertex_triangles, neighbor_count(num_vertices, 0);
+    std::vector<bool> moved(num_vertices), border(num_vertices);
+    std::vector<unsigned int> remap(num_vertices);
+    std::iota(remap.begin(), remap.end(), 0u);
+
+    const double max_cost = double(max_error) * double(max_error);
+    double error = 0.0;
+    std::vector<SimplifiedLevel> result;
+    size_t target = indices.size() / 3;
+    for (size_t level = 0; level < levels; level++) {
+        target /= 2;
+        const size_t start_triangles = indices.size() / 3;
+        while (indices.size() / 3 > target) {
+            const size_t num_triangles = indices.size() / 3;
+
+            // triangles around each vertex
+            std::fill(first.begin(), first.end(), 0);
+            for (unsigned int v : indices)
+                first[v + 1]++;
+            for (size_t v = 0; v < num_vertices; v++)
+                first[v + 1] += first[v];
+            vertex_triangles.resize(indices.size());
+            {
+                std::vector<unsigned int> fill(first.begin(), first.end() - 1);
+                for (size_t i = 0; i < indices.size(); i++)
+                    vertex_triangles[fill[indices[i]]++] = unsigned(i / 3);
+            }
+
+            // in a closed fan each neighbor shares two triangles with the vertex, otherwise it's a border
+            for (size_t v = 0; v < num_vertices; v++) {
+                bool open = false;
+                for (unsigned int j = first[v]; j < first[v + 1]; j++) {
+                    for (int k = 0; k < 3; k++)
+                        neighbor_count[indices[vertex_triangles[j] * 3 + k]]++;
+                }
+                for (unsigned int j = first[v]; j < first[v + 1]; j++) {
+                    for (int k = 0; k < 3; k++) {
+                        const unsigned int u = indices[vertex_triangles[j] * 3 + k];
+                        open |= (u != v && neighbor_count[u] != 2);
+                    }
+                }
+                for (unsigned int j = first[v]; j < first[v + 1]; j++) {
+                    for (int k = 0; k < 3; k++)
+                        neighbor_count[indices[vertex_triangles[j] * 3 + k]] = 0;
+                }
+                border[v] = open;
+            }
+
+            // candidate collapses along every edge, cheapest first
+            collapses.clear();
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                for (int k = 0; k < 3; k++) {
+                    const unsigned int a = indices[i + k], b = indices[i + (k + 1) % 3];
+                    if (!locked[a] && !border[a])
+                        collapses.push_back({ a, b, collapse_cost(a, b) });
+                    if (!locked[b] && !border[b])
+                        collapses.push_back({ b, a, collapse_cost(b, a) });
+                }
+            }
+            std::sort(collapses.begin(), collapses.end(), [](const Collapse& l, const Collapse& r) { return l.cost < r.cost; });
+
+            // apply the cheapest ones not touching each other, each removes about two triangles
+            std::fill(moved.begin(), moved.end(), false);
+            const size_t wanted = (num_triangles - target + 1) / 2;
+            size_t applied = 0;
+            for (const Collapse& collapse : collapses) {
+                if (collapse.cost > max_cost || applied >= wanted)
+                    break;
+                if (moved[collapse.from] || moved[collapse.to])
+                    continue;
+
+                // reject collapses that would flip a remaining triangle around `from`
+                const glm::vec3 target_position = position(collapse.to);
+                bool flips = false;
+                for (unsigned int j = first[collapse.from]; j < first[collapse.from + 1] && !flips; j++) {
+                    const unsigned int* tri = &indices[vertex_triangles[j] * 3];
+                    if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to)
+                        continue;
+                    glm::vec3 p[3] = { position(tri[0]), position(tri[1]), position(tri[2]) };
+                    const glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    for (int k = 0; k < 3; k++) {
+                        if (tri[k] == collapse.from)
+                            p[k] = target_position;
+                    }
+                    const glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+                    flips = glm::dot(before, after) <= 0.f;
+                }
+                if (flips)
+                    continue;
+
+                remap[collapse.from] = collapse.to;
+                quadrics[collapse.to] += quadrics[collapse.from];
+                error = std::max(error, collapse.cost);
+                for (unsigned int j = first[collapse.from]; j < first[collapse.from + 1]; j++) {
+                    for (int k = 0; k < 3; k++)
+                        moved[indices[vertex_triangles[j] * 3 + k]] = true;
+                }
+                applied++;
+            }
+            if (applied == 0)
+                break;
+
+            // drop triangles that became degenerate
+            size_t write = 0;
+            for (size_t i = 0; i < indices.size(); i += 3) {
+                const unsigned int a = remap[indices[i]], b = remap[indices[i+1]], c = remap[indices[i+2]];
+                if (a == b || b == c || c == a)
+                    continue;
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+            indices.resize(write);
+        }
+        // not worth another level when little was removed
+        if (indices.size() / 3 > start_triangles * 9 / 10)
+            break;
+        result.push_back({ indices, float(std::sqrt(error)) });
+    }
+    return result;
+}
+
+/// Generate simplified levels of detail for every submesh, appended to the mesh index buffer
+static void generate_lods(Mesh& mesh, unsigned levels, float max_error, std::string_view name)
+{
+    const size_t num_vertices = mesh.num_vertices();
+    if (levels == 0 || num_vertices == 0)
+        return;
+
+    // vertices sharing a position with others (split normal/texcoord) lie on attribute seams
+    std::vector<unsigned int> order(num_vertices);
+    std::iota(order.begin(), order.end(), 0u);
+    const auto position = [&](unsigned int v) {
+        const float* p = &mesh.vertices[v * Mesh::kFloatsPerVertex];
+        return std::make_tuple(p[0], p[1], p[2]);
+    };
+    std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) { return position(a) < position(b); });
+    std::vector<bool> seam(num_vertices, false);
+    for (size_t i = 1; i < num_vertices; i++) {
+        if (position(order[i]) == position(order[i - 1]))
+            seam[order[i]] = seam[order[i - 1]] = true;
+    }
+
+    std::vector<MeshLod> lods(levels);
+    size_t num_lods = 0;
+    for (const SubMesh& submesh : mesh.submeshes) {
+        const auto simplified = simplify_triangles(mesh, seam, &mesh.indices[submesh.index_offset], submesh.index_count,
+                                                   levels, max_error * mesh.radius);
+        num_lods = std::max(num_lods, simplified.size());
+        SubMesh range = submesh;
+        float error = 0.f;
+        for (size_t level = 0; level < levels; level++) {
+            // levels past the last one simplified keep drawing it
+            if (level < simplified.size()) {
+                range.index_offset = mesh.indices.size();
+                range.index_count = simplified[level].indices.size();
+                mesh.indices.insert(mesh.indices.end(), simplified[level].indices.begin(), simplified[level].indices.end());
+                error = simplified[level].error;
+            }
+            lods[level].submeshes.push_back(range);
+            lods[level].error = std::max(lods[level].error, error);
+        }
+    }
+    lods.resize(num_lods);
+    mesh.lods = std::move(lods);
+
+    if (!mesh.lods.empty()) {
+        std::string triangles;
+        for (const MeshLod& lod : mesh.lods) {
+            size_t count = 0;
+            for (const SubMesh& submesh : lod.submeshes)
+                count += submesh.index_count / 3;
+            triangles += " " + std::to_string(count);
+        }
+        DEBUG("Generated {} LODs for mesh {}, triangles:{}", mesh.lods.size(), name, triangles);
+    }
+}
+
+/// Load an OBJ model meshes and materials from file, without the material textures
+ModelRef parse_model(std::string_view filepath, const ModelLoadOptions& options)
+{
+    const auto stage_done = [&](LoadStage stage) {
+        if (options.stage_hook)
+            options.stage_hook(stage, options.stage_cookie);
+    };
+
+    const std::string cache_path = options.cache ? mesh_cache_path(filepath, options) : std::string();
+    if (options.cache) {
+        if (auto model = load_cooked_model(cache_path, mesh_cache_flags(options))) {
+            stage_done(LoadStage::READ);
+            DEBUG("Loaded OBJ file {} from mesh cache {}", filepath, cache_path);
+            model->mesh.vertex_format = options.vertex_format;
+            return model;
+        }
+    }
+
+    const auto file = FileView::open(std::string(filepath));
+    if (!file) {
+        ERROR("Failed to open OBJ file {}", filepath);
+        return nullptr;
+    }
+    stage_done(LoadStage::READ);
+
+    // Temporary data of the load, released all at once on return
+    Arena arena;
+
+    // Count records of chunks of lines in parallel, then parse them straight into arrays of the exact size
+    constexpr size_t kMinChunkSize = 256 * 1024;
+    size_t num_threads = options.threads ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    num_threads = std::clamp<size_t>(file->size() / kMinChunkSize, 1, num_threads);
+    const auto pieces = split_lines(file->str(), num_threads);
+    std::vector<ObjChunk> chunks(pieces.size());
+    parallel_for_each(chunks.size(), [&](size_t i) {
+        chunks[i].text = pieces[i];
+        chunks[i].counts = count_obj_records(pieces[i]);
+    });
+
+    ObjCounts total;
+    for (ObjChunk& chunk : chunks) {
+        chunk.base = glm::u32vec3(total.positions, total.texcoords, total.normals);
+        total.positions += chunk.counts.positions;
+        total.texcoords += chunk.counts.texcoords;
+        total.normals += chunk.counts.normals;
+        total.corners += chunk.counts.corners;
+    }
+    glm::vec3* const positions = arena.allocate<glm::vec3>(total.positions);
+    glm::vec2* const texcoords = arena.allocate<glm::vec2>(total.texcoords);
+    glm::vec3* const normals = arena.allocate<glm::vec3>(total.normals);
+    for (ObjChunk& chunk : chunks) {
+        chunk.positions = positions + chunk.base[0];
+        chunk.texcoords = texcoords + chunk.base[1];
+        chunk.normals = normals + chunk.base[2];
+    }
+    parallel_for_each(chunks.size(), [&](size_t i) { parse_obj_chunk(chunks[i]); });
+    stage_done(LoadStage::TOKENIZE);
+
+    size_t num_corners = 0; // the counting pass is only an estimate for malformed faces
+    for (const ObjChunk& chunk : chunks)
+        num_corners += chunk.corners.size();
+
+    Model model;
+    model.sources = { std::string(filepath) };
+    Mesh& mesh = model.mesh;
+    mesh.vertex_format = options.vertex_format;
+    VertexIndexTable unique_vertices(arena, num_corners);
+    float* const vertices = arena.allocate<float>(num_corners * Mesh::kFloatsPerVertex);
+    uint32_t num_vertices = 0;
+    unsigned int* const indices = arena.allocate<unsigned int>(num_corners); // in file order
+    size_t num_indices = 0;
+    ArenaVector<unsigned int> smooth_vertices{ ArenaAllocator<unsigned int>(arena) }; // vertices of corners without normal index
+
+    // Faces are grouped per 'usemtl' so that each material ends up as one contiguous index range
+    struct FaceRun {
+        size_t group;
+        size_t begin, end; // range of `indices`
+    };
+    std::vector<std::string> groups(1); // material names, in order of first use
+    ArenaVector<FaceRun> runs{ ArenaAllocator<FaceRun>(arena) };
+    runs.push_back({ 0, 0, 0 });
+
+    const auto apply_statement = [&](const ObjChunk::Statement& stmt) {
+        if (stmt.code == "usemtl") {
+            auto it = std::find(groups.begin(), groups.end(), stmt.arg);
+            if (it == groups.end())
+                it = groups.emplace(it, stmt.arg);
+            runs.back().end = num_indices;
+            runs.push_back({ size_t(it - groups.begin()), num_indices, num_indices });
+        }
+        else if (stmt.code == "mtllib") {
+            auto mtlpath = std::filesystem::path(filepath).remove_filename().append(stmt.arg).string();
+            auto mtl = load_mtl(mtlpath);
+            if (!mtl) {
+                ERROR("Failed to read MTL file: {}", mtlpath);
+                return false;
+            }
+            model.materials.insert(model.materials.end(), mtl->begin(), mtl->end());
+            model.sources.push_back(std::move(mtlpath));
+        }
+        return true;
+    };
+
+    // Resolve face corners into unique vertices, in file order
+    for (const ObjChunk& chunk : chunks) {
+        auto stmt = chunk.statements.begin();
+        for (size_t c = 0; c <= chunk.corners.size(); c++) {
+            for (; stmt != chunk.statements.end() && stmt->corner == c; ++stmt)
+                if (!apply_statement(*stmt))
+                    return nullptr;
+            if (c == chunk.corners.size())
+                break;
+            const glm::u32vec3& corner = chunk.corners[c];
+            const uint32_t fv = corner[0], fvt = corner[1], fvn = corner[2];
+            /* index is offset by 1, texcoord and normal are 0 when absent */
+            if (fv - 1 >= total.positions || (fvt && fvt - 1 >= total.texcoords) || (fvn && fvn - 1 >= total.normals)) {
+                ERROR("Invalid face index {}/{}/{} in OBJ file {}", fv, fvt, fvn, filepath);
+                return nullptr;
+            }
+            const auto [index, inserted] = unique_vertices.insert(corner, num_vertices);
+            indices[num_indices++] = index;
+            if (inserted) {
+                const glm::vec3& p = positions[fv - 1];
+                const glm::vec2 t = fvt ? texcoords[fvt - 1] : glm::vec2(0.f);
+                const glm::vec3 n = fvn ? normals[fvn - 1] : glm::vec3(0.f);
+                const float vertex[Mesh::kFloatsPerVertex] = { p.x, p.y, p.z, t.s, t.t, n.x, n.y, n.z };
+                std::copy(std::begin(vertex), std::end(vertex), vertices + size_t(num_vertices++) * Mesh::kFloatsPerVertex);
+                if (!fvn)
+                    smooth_vertices.push_back(index);
+            }
+            // corners without normal get the area weighted normal of the triangles around them
+            if (c % 3 == 2 && !(chunk.corners[c - 2][2] && chunk.corners[c - 1][2] && fvn)) {
+                const unsigned int* tri = &indices[num_indices - 3];
+                const auto position = [&](unsigned int v) { return glm::make_vec3(&vertices[v * Mesh::kFloatsPerVertex]); };
+                const glm::vec3 normal = glm::cross(position(tri[1]) - position(tri[0]), position(tri[2]) - position(tri[0]));
+                for (int k = 0; k < 3; k++) {
+                    if (!chunk.corners[c - 2 + k][2]) {
+                        float* n = &vertices[tri[k] * Mesh::kFloatsPerVertex + 5];
+                        n[0] += normal.x; n[1] += normal.y; n[2] += normal.z;
+                    }
+                }
+            }
+        }
+    }
+    runs.back().end = num_indices;
+    for (unsigned int v : smooth_vertices) {
+        float* n = &vertices[v * Mesh::kFloatsPerVertex + 5];
+        const float length = glm::length(glm::make_vec3(n));
+        if (length > 0.f)
+            n[0] /= length, n[1] /= length, n[2] /= length;
+    }
+
+    // Only the compact vertex and index arrays outlive the load
+    mesh.vertices.assign(vertices, vertices + size_t(num_vertices) * Mesh::kFloatsPerVertex);
+    mesh.indices.resize(num_indices);
+
+    // Gather face runs into the shared index buffer, one submesh per material
+    size_t offset = 0;
+    for (size_t group = 0; group < groups.size(); group++) {
+        const size_t begin = offset;
+        for (const FaceRun& run : runs) {
+            if (run.group == group) {
+                std::copy(indices + run.begin, indices + run.end, mesh.indices.begin() + offset);
+                offset += run.end - run.begin;
+            }
+        }
+        if (offset == begin)
+            continue;
+        SubMesh& submesh = mesh.submeshes.emplace_back();
+        submesh.index_offset = begin;
+        submesh.index_count = offset - begin;
+        const std::string& name = groups[group];
+        auto it = std::find_if(model.materials.begin(), model.materials.end(), [&](auto& m) { return m->name == name; });
+        if (it != model.materials.end())
+            submesh.material = *it;
+        else if (!name.empty())
+            WARN("Material '{}' not found for OBJ file {}", name, filepath);
+    }
+
+    stage_done(LoadStage::DEDUPE);
+
+    compute_bounds(mesh);
+    generate_lods(mesh, options.lod_levels, options.lod_error, filepath);
+    stage_done(LoadStage::SIMPLIFY);
+
+    if (options.optimize)
+        optimize_mesh(mesh, filepath);
+    stage_done(LoadStage::OPTIMIZE);
+
+    if (options.cache) {
+        save_cooked_model(cache_path, model, mesh_cache_flags(options));
+        stage_done(LoadStage::COOK);
+    }
+
+    return std::make_shared<Model>(std::move(model));
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TEXTURE
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// GL internal format of a texture format
+static GLenum texture_gl_format(TextureFormat format)
+{
+    switch (format) {
+        case TextureFormat::RGB8: return GL_RGB;
+        case TextureFormat::BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+        case TextureFormat::BC3: return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        default: return GL_RGBA;
+    }
+}
+
+GLenum CookedTexture::gl_format() const
+{
+    return texture_gl_format(format);
+}
+
+GLenum TiledTexture::gl_format() const
+{
+    return texture_gl_format(format);
+}
+
+/// Size in bytes of a texture level
+static size_t texture_level_size(TextureFormat format, uint32_t width, uint32_t height)
+{
+    const size_t blocks = size_t((width + 3) / 4) * ((height + 3) / 4);
+    switch (format) {
+        case TextureFormat::RGB8: return size_t(width) * height * 3;
+        case TextureFormat::RGBA8: return size_t(width) * height * 4;
+        case TextureFormat::BC1: return blocks * 8;
+        default: return blocks * 16;
+    }
+}
+
+/// Halve an image with a 2x2 box filter (the last row/column of odd sizes is dropped)
+static void downsample_image(const uint8_t* src, uint32_t width, uint32_t height, int channels, uint8_t* dst)
+{
+    const uint32_t dst_width = std::max(1u, width / 2), dst_height = std::max(1u, height / 2);
+    const size_t stride = size_t(width) * channels;
+    for (uint32_t y = 0; y < dst_height; y++) {
+        const uint8_t* row0 = src + std::min(2 * y, height - 1) * stride;
+        const uint8_t* row1 = src + std::min(2 * y + 1, height - 1) * stride;
+        for (uint32_t x = 0; x < dst_width; x++) {
+            const size_t x0 = std::min(2 * x, width - 1) * channels, x1 = std::min(2 * x + 1, width - 1) * channels;
+            for (int c = 0; c < channels; c++)
+                *dst++ = uint8_t((row0[x0 + c] + row0[x1 + c] + row1[x0 + c] + row1[x1 + c] + 2) / 4);
+        }
+    }
+}
+
+/// Quantize a color to RGB 5:6:5
+static uint16_t pack_rgb565(const float* c)
+{
+    const auto q = [](float v, int max) { return unsigned(std::clamp(v, 0.f, 255.f) * max / 255.f + 0.5f); };
+    return uint16_t((q(c[0], 31) << 11) | (q(c[1], 63) << 5) | q(c[2], 31));
+}
+
+static void unpack_rgb565(uint16_t v, int* c)
+{
+    const int r = (v >> 11) & 31, g = (v >> 5) & 63, b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+/// Choose the nearest of the 4 colors interpolated between two 5:6:5 endpoints (c0 > c1) for each pixel.
+/// Returns the 2-bit indices and the total squared error.
+static std::pair<uint32_t, int> bc1_indices(const uint8_t block[16][4], uint16_t c0, uint16_t c1)
+{
+    int palette[4][3];
+    unpack_rgb565(c0, palette[0]);
+    unpack_rgb565(c1, palette[1]);
+    for (int c = 0; c < 3; c++) {
+        palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+        palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+    }
+    uint32_t indices = 0;
+    int error = 0;
+    for (int i = 0; i < 16; i++) {
+        int best = 0, best_dist = INT_MAX;
+        for (int p = 0; p < 4; p++) {
+            const int dr = block[i][0] - palette[p][0], dg = block[i][1] - palette[p][1], db = block[i][2] - palette[p][2];
+            const int dist = dr * dr + dg * dg + db * db;
+            if (dist < best_dist) { best_dist = dist; best = p; }
+        }
+        indices |= uint32_t(best) << (2 * i);
+        error += best_dist;
+    }
+    return { indices, error };
+}
+
+/// Encode the colors of a 4x4 block of RGBA pixels as a BC1 block, always in 4-color mode.
+/// Endpoints start at the extremes of the colors along their principal axis, then are
+/// refit by least squares to the chosen indices while that lowers the error.
+static void encode_bc1_block(const uint8_t block[16][4], uint8_t* out)
+{
+    float mean[3] = { 0.f, 0.f, 0.f };
+    for (int i = 0; i < 16; i++)
+        for (int c = 0; c < 3; c++)
+            mean[c] += block[i][c] / 16.f;
+    float cov[6] = { 0.f }; // rr rg rb gg gb bb
+    for (int i = 0; i < 16; i++) {
+        const float r = block[i][0] - mean[0], g = block[i][1] - mean[1], b = block[i][2] - mean[2];
+        cov[0] += r * r; cov[1] += r * g; cov[2] += r * b;
+        cov[3] += g * g; cov[4] += g * b; cov[5] += b * b;
+    }
+    float axis[3] = { 1.f, 1.f, 1.f };
+    for (int iter = 0; iter < 4; iter++) { // power iteration
+        const float x = axis[0] * cov[0] + axis[1] * cov[1] + axis[2] * cov[2];
+        const float y = axis[0] * cov[1] + axis[1] * cov[3] + axis[2] * cov[4];
+        const float z = axis[0] * cov[2] + axis[1] * cov[4] + axis[2] * cov[5];
+        const float norm = std::max({ std::abs(x), std::abs(y), std::abs(z) });
+        if (norm < 1e-6f)
+            break;
+        axis[0] = x / norm; axis[1] = y / norm; axis[2] = z / norm;
+    }
+    int lo = 0, hi = 0;
+    float lo_dot = std::numeric_limits<float>::max(), hi_dot = -lo_dot;
+    for (int i = 0; i < 16; i++) {
+        const float dot = block[i][0] * axis[0] + block[i][1] * axis[1] + block[i][2] * axis[2];
+        if (dot < lo_dot) { lo_dot = dot; lo = i; }
+        if (dot > hi_dot) { hi_dot = dot; hi = i; }
+    }
+    const float hi_color[3] = { float(block[hi][0]), float(block[hi][1]), float(block[hi][2]) };
+    const float lo_color[3] = { float(block[lo][0]), float(block[lo][1]), float(block[lo][2]) };
+    uint16_t c0 = pack_rgb565(hi_color), c1 = pack_rgb565(lo_color);
+    if (c0 < c1)
+        std::swap(c0, c1);
+
+    // with equal endpoints every index is 0, as 4-color mode needs c0 > c1
+    uint32_t indices = 0;
+    if (c0 != c1) {
+        int error;
+        std::tie(indices, error) = bc1_indices(block, c0, c1);
+        static constexpr float kWeight0[4] = { 1.f, 0.f, 2.f / 3.f, 1.f / 3.f }; // of c0 in each palette entry
+        for (int iter = 0; iter < 2 && error > 0; iter++) {
+            float aa = 0.f, ab = 0.f, bb = 0.f, ax[3] = { 0.f }, bx[3] = { 0.f };
+            for (int i = 0; i < 16; i++) {
+                const float wa = kWeight0[(indices >> (2 * i)) & 3], wb = 1.f - wa;
+                aa += wa * wa; ab += wa * wb; bb += wb * wb;
+                for (int c = 0; c < 3; c++) {
+                    ax[c] += wa * block[i][c];
+                    bx[c] += wb * block[i][c];
+                }
+            }
+            const float det = aa * bb - ab * ab;
+            if (std::abs(det) < 1e-6f)
+                break;
+            float a[3], b[3];
+            for (int c = 0; c < 3; c++) {
+                a[c] = (ax[c] * bb - bx[c] * ab) / det;
+                b[c] = (bx[c] * aa - ax[c] * ab) / det;
+            }
+            uint16_t r0 = pack_rgb565(a), r1 = pack_rgb565(b);
+            if (r0 < r1)
+                std::swap(r0, r1);
+            if (r0 == r1)
+                break;
+            const auto [refit, refit_error] = bc1_indices(block, r0, r1);
+            if (refit_error >= error)
+                break;
+            c0 = r0, c1 = r1, indices = refit, error = refit_error;
+        }
+    }
+    std::memcpy(out, &c0, 2);
+    std::memcpy(out + 2, &c1, 2);
+    std::memcpy(out + 4, &indices, 4);
+}
+
+/// Encode the alpha of a 4x4 block of RGBA pixels as a BC3 alpha block, in 8-alpha mode
+static void encode_bc3_alpha_block(const uint8_t block[16][4], uint8_t* out)
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++) {
+        a0 = std::max<int>(a0, block[i][3]);
+        a1 = std::min<int>(a1, block[i][3]);
+    }
+    uint64_t indices = 0;
+    if (a0 != a1) {
+        int palette[8] = { a0, a1 };
+        for (int p = 1; p < 7; p++)
+            palette[p + 1] = ((7 - p) * a0 + p * a1) / 7;
+        for (int i = 0; i < 16; i++) {
+            int best = 0;
+            for (int p = 1; p < 8; p++)
+                if (std::abs(block[i][3] - palette[p]) < std::abs(block[i][3] - palette[best]))
+                    best = p;
+            indices |= uint64_t(best) << (3 * i);
+        }
+    }
+    out[0] = uint8_t(a0);
+    out[1] = uint8_t(a1);
+    for (int b = 0; b < 6; b++)
+        out[2 + b] = uint8_t(indices >> (8 * b));
+}
+
+/// Block-compress an image level to BC1 or BC3, blocks past the edges repeat the last row/column
+static void encode_bc_level(const uint8_t* src, uint32_t width, uint32_t height, int channels, TextureFormat format, uint8_t* out)
+{
+    uint8_t block[16][4];
+    for (uint32_t by = 0; by < height; by += 4) {
+        for (uint32_t bx = 0; bx < width; bx += 4) {
+            for (int i = 0; i < 16; i++) {
+                const uint32_t x = std::min(bx + i % 4, width - 1), y = std::min(by + i / 4, height - 1);
+                const uint8_t* pixel = src + (size_t(y) * width + x) * channels;
+                block[i][0] = pixel[0];
+                block[i][1] = pixel[1];
+                block[i][2] = pixel[2];
+                block[i][3] = (channels == 4) ? pixel[3] : 255;
+            }
+            if (format == TextureFormat::BC3) {
+                encode_bc3_alpha_block(block, out);
+                out += 8;
+            }
+            encode_bc1_block(block, out);
+            out += 8;
+        }
+    }
+}
+
+/// Format to cook a decoded image to: BC1 unless some pixel is not opaque when compressing
+static TextureFormat cook_format(const uint8_t* pixels, int width, int height, int channels, bool compress)
+{
+    bool opaque = (channels == 3);
+    if (channels == 4) {
+        opaque = true;
+        for (size_t i = 3; i < size_t(width) * height * 4 && opaque; i += 4)
+            opaque = (pixels[i] == 255);
+    }
+    if (compress)
+        return opaque ? TextureFormat::BC1 : TextureFormat::BC3;
+    return (channels == 4) ? TextureFormat::RGBA8 : TextureFormat::RGB8;
+}
+
+/// Build the mip chain of a decoded image, block-compressed if the options say so
+CookedTexture cook_texture(const uint8_t* pixels, int width, int height, int channels, const TextureCookOptions& options)
+{
+    CookedTexture cooked;
+    cooked.format = cook_format(pixels, width, height, channels, options.compress);
+
+    // level sizes and offsets first, then fill the levels in place
+    struct LevelSpan { uint32_t width, height; size_t offset, size; };
+    std::vector<LevelSpan> spans;
+    size_t total = 0;
+    for (uint32_t w = width, h = height;; w = std::max(1u, w / 2), h = std::max(1u, h / 2)) {
+        const size_t size = texture_level_size(cooked.format, w, h);
+        spans.push_back({ w, h, total, size });
+        total += size;
+        if (w == 1 && h == 1)
+            break;
+    }
+    cooked.storage.resize(total);
+
+    std::vector<uint8_t> level(pixels, pixels + size_t(width) * height * channels), next;
+    for (const LevelSpan& span : spans) {
+        uint8_t* out = cooked.storage.data() + span.offset;
+        if (cooked.is_compressed())
+            encode_bc_level(level.data(), span.width, span.height, channels, cooked.format, out);
+        else
+            std::memcpy(out, level.data(), span.size);
+        cooked.levels.push_back({ span.width, span.height, out, span.size });
+        if (span.width > 1 || span.height > 1) {
+            next.resize(size_t(std::max(1u, span.width / 2)) * std::max(1u, span.height / 2) * channels);
+            downsample_image(level.data(), span.width, span.height, channels, next.data());
+            std::swap(level, next);
+        }
+    }
+    return cooked;
+}
+
+/// Cooked texture file layout:
+///   TextureCacheHeader | tables (source, levels) | level blobs
+/// Level blobs are aligned so they can be uploaded straight from the file mapping.
+struct TextureCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t num_levels;
+    uint64_t file_size;
+};
+
+static constexpr char kTextureCacheMagic[4] = { 'S', 'G', 'L', 'T' };
+static constexpr uint32_t kTextureCacheVersion = 1;
+static constexpr size_t kTextureCacheAlign = 64;
+
+/// Path of the cooked texture file for an image file
+static std::string texture_cache_path(std::string_view filepath, const TextureCookOptions& options)
+{
+    return cache_file_path(filepath, options.cache_dir, ".sgltex");
+}
+
+/// Load a texture from the texture cache, if present and up to date with its image file
+auto load_cooked_texture(std::string_view filepath, const TextureCookOptions& options) -> std::optional<CookedTexture>
+{
+    const std::string cache_path = texture_cache_path(filepath, options);
+    std::error_code ec;
+    if (!std::filesystem::exists(cache_path, ec))
+        return std::nullopt;
+    auto file = FileView::open(cache_path);
+    if (!file || file->size() < sizeof(TextureCacheHeader))
+        return std::nullopt;
+
+    TextureCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    const auto format = TextureFormat(header.format);
+    const bool compressed = (format == TextureFormat::BC1 || format == TextureFormat::BC3);
+    const bool valid_header = std::memcmp(header.magic, kTextureCacheMagic, sizeof(header.magic)) == 0
+        && header.version == kTextureCacheVersion
+        && header.format <= uint32_t(TextureFormat::BC3)
+        && compressed == options.compress
+        && header.file_size == file->size()
+        && header.num_levels > 0 && header.num_levels <= 32;
+    if (!valid_header) {
+        DEBUG("Texture cache {} is invalid or cooked with other options", cache_path);
+        return std::nullopt;
+    }
+
+    BinaryReader in(file->data() + sizeof(header), file->data() + file->size());
+    const std::string source(in.get_str());
+    const auto mtime = in.get<int64_t>();
+    const auto size = in.get<uint64_t>();
+    if (source_stamp(std::string(filepath)) != std::make_pair(mtime, size)) {
+        DEBUG("Texture cache {} is out of date with {}", cache_path, source);
+        return std::nullopt;
+    }
+
+    CookedTexture cooked;
+    cooked.format = format;
+    for (uint32_t n = 0; n < header.num_levels && in.ok(); n++) {
+        CookedTexture::Level level;
+        level.width = in.get<uint32_t>();
+        level.height = in.get<uint32_t>();
+        const auto offset = in.get<uint64_t>();
+        level.size = in.get<uint64_t>();
+        if (offset > file->size() || level.size > file->size() - offset
+            || level.size != texture_level_size(format, level.width, level.height)) {
+            WARN("Invalid texture cache {}, ignoring it", cache_path);
+            return std::nullopt;
+        }
+        level.data = reinterpret_cast<const uint8_t*>(file->data()) + offset;
+        cooked.levels.push_back(level);
+    }
+    if (!in.ok()) {
+        WARN("Invalid texture cache {}, ignoring it", cache_path);
+        return std::nullopt;
+    }
+    cooked.file = std::make_shared<FileView>(std::move(*file));
+    return cooked;
+}
+
+/// Save a cooked texture in the texture cache, along with the version of its image file
+void save_cooked_texture(std::string_view filepath, const CookedTexture& texture, const TextureCookOptions& options)
+{
+    const std::string cache_path = texture_cache_path(filepath, options);
+    BinaryWriter out;
+
+    TextureCacheHeader header{};
+    std::memcpy(header.magic, kTextureCacheMagic, sizeof(header.magic));
+    header.version = kTextureCacheVersion;
+    header.format = uint32_t(texture.format);
+    header.num_levels = texture.levels.size();
+    out.put(header);
+
+    if (!put_source_stamp(out, std::string(filepath))) {
+        WARN("Failed to stat {}, not caching texture", filepath);
+        return;
+    }
+    // level table, offsets follow once the table size is known
+    const size_t table_offset = out.size();
+    const size_t table_entry = 2 * sizeof(uint32_t) + 2 * sizeof(uint64_t);
+    size_t offset = (table_offset + texture.levels.size() * table_entry + kTextureCacheAlign - 1) / kTextureCacheAlign * kTextureCacheAlign;
+    for (const CookedTexture::Level& level : texture.levels) {
+        out.put(level.width);
+        out.put(level.height);
+        out.put<uint64_t>(offset);
+        out.put<uint64_t>(level.size);
+        offset = (offset + level.size + kTextureCacheAlign - 1) / kTextureCacheAlign * kTextureCacheAlign;
+    }
+    for (const CookedTexture::Level& level : texture.levels) {
+        out.align(kTextureCacheAlign);
+        out.put_bytes(level.data, level.size);
+    }
+
+    header.file_size = out.size();
+    std::memcpy(out.buffer().data(), &header, sizeof(header));
+    if (!write_cache_file(cache_path, out.buffer()))
+        return;
+    DEBUG("Saved texture cache {} ({} bytes)", cache_path, out.size());
+}
+
+/// Cut the mip chain of a decoded image into tiles, block-compressed if the options say so
+TiledTexture cook_tiled_texture(const uint8_t* pixels, int width, int height, int channels, const TextureCookOptions& options)
+{
+    constexpr uint32_t kSize = TiledTexture::kTileSize, kBorder = TiledTexture::kTileBorder, kContent = TiledTexture::kTileContent;
+    TiledTexture tiled;
+    tiled.format = cook_format(pixels, width, height, channels, options.compress);
+    tiled.tile_size = texture_level_size(tiled.format, kSize, kSize);
+
+    size_t num_tiles = 0;
+    for (uint32_t w = width, h = height;; w = std::max(1u, w / 2), h = std::max(1u, h / 2)) {
+        TiledTexture::Level level{ w, h, (w + kContent - 1) / kContent, (h + kContent - 1) / kContent, num_tiles };
+        tiled.levels.push_back(level);
+        num_tiles += size_t(level.tiles_x) * level.tiles_y;
+        if (w <= kContent && h <= kContent)
+            break;
+    }
+    tiled.storage.resize(num_tiles * tiled.tile_size);
+    tiled.tiles = tiled.storage.data();
+
+    std::vector<uint8_t> level_pixels(pixels, pixels + size_t(width) * height * channels), next;
+    std::vector<uint8_t> tile(size_t(kSize) * kSize * channels);
+    for (const TiledTexture::Level& level : tiled.levels) {
+        for (uint32_t ty = 0; ty < level.tiles_y; ty++) {
+            for (uint32_t tx = 0; tx < level.tiles_x; tx++) {
+                // tile texels, with the border and past the level edges clamped to the edges
+                uint8_t* dst = tile.data();
+                for (uint32_t y = 0; y < kSize; y++) {
+                    const int64_t sy = std::clamp<int64_t>(int64_t(ty * kContent + y) - kBorder, 0, level.height - 1);
+                    for (uint32_t x = 0; x < kSize; x++) {
+                        const int64_t sx = std::clamp<int64_t>(int64_t(tx * kContent + x) - kBorder, 0, level.width - 1);
+                        std::memcpy(dst, level_pixels.data() + (size_t(sy) * level.width + sx) * channels, channels);
+                        dst += channels;
+                    }
+                }
+                uint8_t* out = tiled.storage.data() + (level.first_tile + size_t(ty) * level.tiles_x + tx) * tiled.tile_size;
+                if (tiled.is_compressed())
+                    encode_bc_level(tile.data(), kSize, kSize, channels, tiled.format, out);
+                else
+                    std::memcpy(out, tile.data(), tiled.tile_size);
+            }
+        }
+        if (&level != &tiled.levels.back()) {
+            next.resize(size_t(std::max(1u, level.width / 2)) * std::max(1u, level.height / 2) * channels);
+            downsample_image(level_pixels.data(), level.width, level.height, channels, next.data());
+            std::swap(level_pixels, next);
+        }
+    }
+    return tiled;
+}
+
+/// Tiled texture file layout:
+///   TiledCacheHeader | tables (source, levels) | tiles
+/// Tiles are stored back to back from an aligned offset, in the order of TiledTexture.
+struct TiledCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t format;
+    uint32_t num_levels;
+    uint32_t tile_size;   // texels per side, border included
+    uint32_t tile_border;
+    uint64_t tiles_offset;
+    uint64_t file_size;
+};
+
+static constexpr char kTiledCacheMagic[4] = { 'S', 'G', 'L', 'V' };
+static constexpr uint32_t kTiledCacheVersion = 1;
+
+/// Path of the tiled texture file for an image file
+static std::string tiled_cache_path(std::string_view filepath, const TextureCookOptions& options)
+{
+    return cache_file_path(filepath, options.cache_dir, ".sgltile");
+}
+
+/// Load a tiled texture from the texture cache, if present and up to date with its image file
+auto load_tiled_texture(std::string_view filepath, const TextureCookOptions& options) -> std::optional<TiledTexture>
+{
+    const std::string cache_path = tiled_cache_path(filepath, options);
+    std::error_code ec;
+    if (!std::filesystem::exists(cache_path, ec))
+        return std::nullopt;
+    auto file = FileView::open(cache_path);
+    if (!file || file->size() < sizeof(TiledCacheHeader))
+        return std::nullopt;
+
+    TiledCacheHeader header;
+    std::memcpy(&header, file->data(), sizeof(header));
+    const auto format = TextureFormat(header.format);
+    const bool compressed = (format == TextureFormat::BC1 || format == TextureFormat::BC3);
+    const bool valid_header = std::memcmp(header.magic, kTiledCacheMagic, sizeof(header.magic)) == 0
+        && header.version == kTiledCacheVersion
+        && header.format <= uint32_t(TextureFormat::BC3)
+        && compressed == options.compress
+        && header.tile_size == TiledTexture::kTileSize && header.tile_border == TiledTexture::kTileBorder
+        && header.file_size == file->size() && header.tiles_offset <= file->size()
+        && header.num_levels > 0 && header.num_levels <= 32;
+    if (!valid_header) {
+        DEBUG("Tiled texture cache {} is invalid or cooked with other options", cache_path);
+        return std::nullopt;
+    }
+
+    BinaryReader in(file->data() + sizeof(header), file->data() + file->size());
+    const std::string source(in.get_str());
+    const auto mtime = in.get<int64_t>();
+    const auto size = in.get<uint64_t>();
+    if (source_stamp(std::string(filepath)) != std::make_pair(mtime, size)) {
+        DEBUG("Tiled texture cache {} is out of date with {}", cache_path, source);
+        return std::nullopt;
+    }
+
+    constexpr uint32_t kContent = TiledTexture::kTileContent;
+    TiledTexture tiled;
+    tiled.format = format;
+    tiled.tile_size = texture_level_size(format, TiledTexture::kTileSize, TiledTexture::kTileSize);
+    size_t num_tiles = 0;
+    for (uint32_t n = 0; n < header.num_levels && in.ok(); n++) {
+        TiledTexture::Level level;
+        level.width = in.get<uint32_t>();
+        level.height = in.get<uint32_t>();
+        level.tiles_x = (level.width + kContent - 1) / kContent;
+        level.tiles_y = (level.height + kContent - 1) / kContent;
+        level.first_tile = num_tiles;
+        num_tiles += size_t(level.tiles_x) * level.tiles_y;
+        tiled.levels.push_back(level);
+    }
+    if (!in.ok() || num_tiles * tiled.tile_size != file->size() - header.tiles_offset) {
+        WARN("Invalid tiled texture cache {}, ignoring it", cache_path);
+        return std::nullopt;
+    }
+    tiled.tiles = reinterpret_cast<const uint8_t*>(file->data()) + header.tiles_offset;
+    tiled.file = std::make_shared<FileView>(std::move(*file));
+    return tiled;
+}
+
+/// Save a tiled texture in the texture cache, along with the version of its image file
+void save_tiled_texture(std::string_view filepath, const TiledTexture& texture, const TextureCookOptions& options)
+{
+    const std::string cache_path = tiled_cache_path(filepath, options);
+    BinaryWriter out;
+
+    TiledCacheHeader header{};
+    std::memcpy(header.magic, kTiledCacheMagic, sizeof(header.magic));
+    header.version = kTiledCacheVersion;
+    header.format = uint32_t(texture.format);
+    header.num_levels = texture.levels.size();
+    header.tile_size = TiledTexture::kTileSize;
+    header.tile_border = TiledTexture::kTileBorder;
+    out.put(header);
+
+    if (!put_source_stamp(out, std::string(filepath))) {
+        WARN("Failed to stat {}, not caching texture", filepath);
+        return;
+    }
+    for (const TiledTexture::Level& level : texture.levels) {
+        out.put(level.width);
+        out.put(level.height);
+    }
+    out.align(kTextureCacheAlign);
+    header.tiles_offset = out.size();
+    out.put_bytes(texture.tiles, texture.num_tiles() * texture.tile_size);
+
+    header.file_size = out.size();
+    std::memcpy(out.buffer().data(), &header, sizeof(header));
+    if (!write_cache_file(cache_path, out.buffer()))
+        return;
+    DEBUG("Saved tiled texture cache {} ({} bytes)", cache_path, out.size());
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// UPLOAD
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+Half float_to_half(float value)
+{
+    uint32_t f;
+    std::memcpy(&f, &value, sizeof(f));
+    const uint32_t sign = (f >> 16) & 0x8000;
+    const uint32_t abs = f & 0x7fffffff;
+    if (abs >= 0x7f800000) // inf or nan
+        return { uint16_t(sign | 0x7c00 | (abs > 0x7f800000 ? 0x200 : 0)) };
+    if (abs >= 0x477ff000) // rounds above the max half
+        return { uint16_t(sign | 0x7c00) };
+    if (abs < 0x38800000) { // half subnormal or zero
+        if (abs < 0x33000000)
+            return { uint16_t(sign) };
+        const uint32_t mant = (abs & 0x7fffff) | 0x800000;
+        const uint32_t shift = 126 - (abs >> 23); // align to the half subnormal lsb (2^-24), 14 to 24
+        uint32_t half = mant >> shift;
+        const uint32_t rest = mant & ((1u << shift) - 1), halfway = 1u << (shift - 1);
+        if (rest > halfway || (rest == halfway && (half & 1)))
+            half++;
+        return { uint16_t(sign | half) };
+    }
+    uint32_t half = ((abs - 0x38000000) >> 13);
+    const uint32_t rest = abs & 0x1fff;
+    if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+        half++; // carries into the exponent when needed
+    return { uint16_t(sign | half) };
+}
+
+float half_to_float(Half value)
+{
+    const uint32_t sign = uint32_t(value.bits & 0x8000) << 16;
+    const uint32_t exponent = (value.bits >> 10) & 0x1f;
+    const uint32_t mantissa = value.bits & 0x3ff;
+    uint32_t f;
+    if (exponent == 0x1f) // inf or nan
+        f = sign | 0x7f800000 | (mantissa << 13);
+    else if (exponent != 0)
+        f = sign | ((exponent + 112) << 23) | (mantissa << 13);
+    else if (mantissa == 0)
+        f = sign;
+    else { // subnormal, normal as a float
+        const float magnitude = std::ldexp(float(mantissa), -24);
+        return sign ? -magnitude : magnitude;
+    }
+    float result;
+    std::memcpy(&result, &f, sizeof(result));
+    return result;
+}
+
+/// Encode a unit vector with octahedral mapping to [-1,1]^2
+static glm::vec2 octahedral_encode(glm::vec3 n)
+{
+    const float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+    if (l1 == 0.f)
+        return { 0.f, 0.f };
+    n /= l1;
+    glm::vec2 e(n.x, n.y);
+    if (n.z < 0.f) {
+        e.x = (1.f - std::abs(n.y)) * (n.x >= 0.f ? 1.f : -1.f);
+        e.y = (1.f - std::abs(n.x)) * (n.y >= 0.f ? 1.f : -1.f);
+    }
+    return e;
+}
+
+/// Compress interleaved float vertices (position, texcoord, normal) to the packed layout, setting the quantization of `data`
+static auto pack_vertices(const float* vertices, size_t count, MeshUploadData& data) -> std::vector<PackedVertex>
+{
+    constexpr size_t kStride = Mesh::kFloatsPerVertex;
+    glm::vec3 min(std::numeric_limits<float>::max()), max(std::numeric_limits<float>::lowest());
+    for (size_t i = 0; i < count; i++) {
+        const glm::vec3 position = glm::make_vec3(&vertices[i * kStride]);
+        min = glm::min(min, position);
+        max = glm::max(max, position);
+    }
+    if (count == 0)
+        min = max = glm::vec3(0.f);
+    data.position_offset = min;
+    data.position_scale = max - min;
+
+    const glm::vec3 to_unorm = glm::vec3(65535.f) / glm::max(data.position_scale, glm::vec3(1e-30f));
+    std::vector<PackedVertex> packed(count);
+    for (size_t i = 0; i < count; i++) {
+        const float* v = &vertices[i * kStride];
+        PackedVertex& p = packed[i];
+        for (int c = 0; c < 3; c++)
+            p.position[c] = uint16_t(std::clamp((v[c] - min[c]) * to_unorm[c] + 0.5f, 0.f, 65535.f));
+        p.position[3] = 0;
+        p.texcoord[0] = float_to_half(v[3]);
+        p.texcoord[1] = float_to_half(v[4]);
+        const glm::vec2 normal = octahedral_encode(glm::make_vec3(&v[5]));
+        for (int c = 0; c < 2; c++)
+            p.normal[c] = int16_t(std::round(std::clamp(normal[c], -1.f, 1.f) * 32767.f));
+    }
+    return packed;
+}
+
+/// Convert a mesh vertices and indices to the layout uploaded to GPU buffers
+MeshUploadData prepare_mesh_upload(const Mesh& mesh)
+{
+    MeshUploadData data;
+    const float* vertices = mesh.cooked ? mesh.cooked->vertices : mesh.vertices.data();
+    data.num_vertices = mesh.num_vertices();
+    if (mesh.vertex_format == VertexFormat::COMPRESSED) {
+        data.packed_vertices = pack_vertices(vertices, data.num_vertices, data);
+        data.vertices = data.packed_vertices.data();
+    } else {
+        data.vertices = vertices;
+    }
+
+    // Indices with the narrowest type that addresses all vertices
+    if (mesh.cooked) {
+        data.indices = mesh.cooked->indices;
+        data.num_indices = mesh.cooked->num_indices;
+        data.index_type = mesh.cooked->index_type;
+    } else if (mesh.index_type() == GL_UNSIGNED_SHORT) {
+        data.indices16.assign(mesh.indices.begin(), mesh.indices.end());
+        data.indices = data.indices16.data();
+        data.num_indices = data.indices16.size();
+        data.index_type = GL_UNSIGNED_SHORT;
+    } else {
+        data.indices = mesh.indices.data();
+        data.num_indices = mesh.indices.size();
+        data.index_type = GL_UNSIGNED_INT;
+    }
+    return data;
+}
+
+} // namespace sgl
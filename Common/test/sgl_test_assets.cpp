@@ -0,0 +1,347 @@
+/// Asset loading checks: runs one named check and exits non-zero on the first mismatch it reports.
+///
+/// Usage: sgl_test_assets <check> [models_dir]
+///   half      float -> half -> float round trips over the whole half range, including round-to-even ties
+///   parallel  every OBJ under models_dir loads the same with one thread and with several
+///   floats    the fixed-format float parser agrees bit for bit with std::from_chars on every number
+///             token of the OBJ/MTL files under models_dir, and on edge cases it must accept or leave
+
+#include "sgl_assets.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+
+#include <spdlog/sinks/stdout_color_sinks.h>
+
+namespace fs = std::filesystem;
+
+static unsigned num_failures = 0;
+
+/// Report a failed check, only the first ones are printed
+template<typename... Args>
+static void fail(const char* format, Args... args)
+{
+    if (num_failures++ < 20) {
+        std::fprintf(stderr, format, args...);
+        std::fputc('\n', stderr);
+    }
+}
+
+static uint32_t bits_of(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/// Every file under a directory with the given extension, sorted
+static std::vector<fs::path> find_files(const fs::path& dir, std::string_view extension)
+{
+    std::vector<fs::path> files;
+    std::error_code ec;
+    for (auto it = fs::recursive_directory_iterator(dir, ec); !ec && it != fs::recursive_directory_iterator(); it.increment(ec)) {
+        std::string ext = it->path().extension().string();
+        std::transform(ext.begin(), ext.end(), ext.begin(), [](unsigned char c) { return std::tolower(c); });
+        if (it->is_regular_file() && ext == extension)
+            files.push_back(it->path());
+    }
+    if (ec)
+        fail("Failed to list %s: %s", dir.string().c_str(), ec.message().c_str());
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// HALF FLOATS
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Expect float_to_half to give the given bits
+static void expect_half(float value, uint16_t expected)
+{
+    const uint16_t bits = sgl::float_to_half(value).bits;
+    if (bits != expected)
+        fail("float_to_half(%a) = 0x%04x, expected 0x%04x", double(value), unsigned(bits), unsigned(expected));
+}
+
+static void check_half()
+{
+    // every finite half converts to float and back unchanged
+    for (uint32_t bits = 0; bits < 0x10000; bits++) {
+        if ((bits & 0x7c00) == 0x7c00)
+            continue;
+        const float value = sgl::half_to_float({ uint16_t(bits) });
+        const float reference = std::ldexp(float(bits & 0x3ff) + ((bits & 0x7c00) ? 1024.f : 0.f), int(std::max(1u, (bits >> 10) & 0x1f)) - 25);
+        if (value != ((bits & 0x8000) ? -reference : reference))
+            fail("half_to_float(0x%04x) = %a, expected %a", unsigned(bits), double(value), double(reference));
+        expect_half(value, uint16_t(bits));
+    }
+
+    // halfway between consecutive halves rounds to the even one, anything off the middle to the nearest
+    for (uint32_t bits = 0; bits < 0x7bff; bits++) {
+        const float low = sgl::half_to_float({ uint16_t(bits) });
+        const float high = sgl::half_to_float({ uint16_t(bits + 1) });
+        const float middle = (low + high) / 2; // exact, floats have 13 more mantissa bits
+        const uint16_t even = uint16_t((bits & 1) ? bits + 1 : bits);
+        expect_half(middle, even);
+        expect_half(-middle, uint16_t(0x8000 | even));
+        expect_half(std::nextafter(middle, 0.f), uint16_t(bits));
+        expect_half(std::nextafter(middle, INFINITY), uint16_t(bits + 1));
+    }
+
+    // every float in the half subnormal range, against rounding the exact scaled value
+    for (uint32_t f = 0x33000000; f < 0x38800000; f++) {
+        const float value = bits_float(f);
+        const double scaled = double(value) * 16777216.0; // in units of the smallest subnormal
+        double whole;
+        const double fraction = std::modf(scaled, &whole);
+        if (fraction > 0.5 || (fraction == 0.5 && std::fmod(whole, 2.0) == 1.0))
+            whole += 1.0;
+        expect_half(value, uint16_t(whole));
+    }
+
+    // below half of the smallest subnormal, overflow and specials
+    expect_half(0x1p-25f, 0x0000);
+    expect_half(std::nextafter(0x1p-25f, INFINITY), 0x0001);
+    expect_half(-0x1p-26f, 0x8000);
+    expect_half(65504.f, 0x7bff);
+    expect_half(65520.f, 0x7c00);
+    expect_half(-INFINITY, 0xfc00);
+    if ((sgl::float_to_half(NAN).bits & 0x7fff) <= 0x7c00)
+        fail("float_to_half(nan) is not a nan");
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PARALLEL PARSING
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static bool same_material(const sgl::MaterialRef& a, const sgl::MaterialRef& b)
+{
+    if (!a || !b)
+        return a == b;
+    return a->name == b->name && a->ka == b->ka && a->kd == b->kd && a->ks == b->ks && a->q == b->q
+        && a->diffuse_map == b->diffuse_map;
+}
+
+static bool same_submeshes(const std::vector<sgl::SubMesh>& a, const std::vector<sgl::SubMesh>& b)
+{
+    if (a.size() != b.size())
+        return false;
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].index_offset != b[i].index_offset || a[i].index_count != b[i].index_count
+            || !same_material(a[i].material, b[i].material))
+            return false;
+    }
+    return true;
+}
+
+/// Compare two loads of the same model, bit for bit
+static void compare_models(const std::string& path, const sgl::Model& a, const sgl::Model& b)
+{
+    if (a.mesh.vertices.size() != b.mesh.vertices.size()
+        || std::memcmp(a.mesh.vertices.data(), b.mesh.vertices.data(), a.mesh.vertices.size() * sizeof(float)) != 0)
+        fail("%s: vertices differ", path.c_str());
+    if (a.mesh.indices != b.mesh.indices)
+        fail("%s: indices differ", path.c_str());
+    if (!same_submeshes(a.mesh.submeshes, b.mesh.submeshes))
+        fail("%s: submeshes differ", path.c_str());
+    bool same_lods = a.mesh.lods.size() == b.mesh.lods.size();
+    for (size_t i = 0; same_lods && i < a.mesh.lods.size(); i++)
+        same_lods = a.mesh.lods[i].error == b.mesh.lods[i].error && same_submeshes(a.mesh.lods[i].submeshes, b.mesh.lods[i].submeshes);
+    if (!same_lods)
+        fail("%s: levels of detail differ", path.c_str());
+    if (a.mesh.center != b.mesh.center || a.mesh.radius != b.mesh.radius)
+        fail("%s: bounds differ", path.c_str());
+    bool same_materials = a.materials.size() == b.materials.size();
+    for (size_t i = 0; same_materials && i < a.materials.size(); i++)
+        same_materials = same_material(a.materials[i], b.materials[i]);
+    if (!same_materials)
+        fail("%s: materials differ", path.c_str());
+}
+
+static void check_parallel(const fs::path& models_dir)
+{
+    const std::vector<fs::path> files = find_files(models_dir, ".obj");
+    if (files.empty())
+        fail("No OBJ file under %s", models_dir.string().c_str());
+
+    sgl::ModelLoadOptions serial;
+    serial.cache = false;
+    serial.threads = 1;
+    sgl::ModelLoadOptions parallel = serial;
+    parallel.threads = std::max(4u, std::thread::hardware_concurrency());
+
+    for (const fs::path& file : files) {
+        const std::string path = file.generic_string();
+        const sgl::ModelRef a = sgl::parse_model(path, serial);
+        const sgl::ModelRef b = sgl::parse_model(path, parallel);
+        if (!a || !b)
+            fail("%s: failed to load with %u threads", path.c_str(), a ? parallel.threads : serial.threads);
+        else
+            compare_models(path, *a, *b);
+    }
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// FLOAT PARSING
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Tokens parsed, and accepted by parse_fixed_float instead of left for std::from_chars
+static size_t num_tokens = 0, num_accepted = 0;
+
+/// Parse a token followed by `padding` blanks with parse_fixed_float, which is either left for
+/// std::from_chars or must give the same float and end at the same place
+static void check_token(std::string_view token, size_t padding)
+{
+    std::string text(token);
+    text.append(padding, ' ');
+    const char* begin = text.data();
+    const char* end = begin + text.size();
+
+    float expected = 0.f;
+    const auto [expected_end, ec] = std::from_chars(begin, end, expected);
+    const bool whole_token = (ec == std::errc() && expected_end == begin + token.size());
+
+    float value = 0.f;
+    const char* parsed_end = sgl::parse_fixed_float(begin, end, value);
+    num_tokens++;
+    if (!parsed_end)
+        return;
+    num_accepted++;
+    if (!whole_token)
+        fail("\"%.*s\" is not a number for from_chars, but parsed as %a", int(token.size()), token.data(), double(value));
+    else if (parsed_end != expected_end)
+        fail("\"%.*s\" parsed %zu characters, expected %zu", int(token.size()), token.data(), size_t(parsed_end - begin), token.size());
+    else if (bits_of(value) != bits_of(expected))
+        fail("\"%.*s\" parsed as %a, expected %a", int(token.size()), token.data(), double(value), double(expected));
+}
+
+/// Check a token with and without room for the 16-byte SIMD window
+static void check_float(std::string_view token)
+{
+    check_token(token, 0);
+    check_token(token, 1);
+    check_token(token, 32);
+}
+
+/// Forms that have to be left for std::from_chars
+static void expect_fallback(std::string_view token)
+{
+    for (size_t padding : { 0, 1, 32 }) {
+        std::string text(token);
+        text.append(padding, ' ');
+        float value;
+        if (sgl::parse_fixed_float(text.data(), text.data() + text.size(), value))
+            fail("\"%.*s\" should be left for from_chars", int(token.size()), token.data());
+    }
+}
+
+static void check_floats(const fs::path& models_dir)
+{
+    // every distinct blank-separated token of the model files
+    std::unordered_set<std::string> tokens;
+    std::vector<fs::path> files = find_files(models_dir, ".obj");
+    const std::vector<fs::path> mtl_files = find_files(models_dir, ".mtl");
+    files.insert(files.end(), mtl_files.begin(), mtl_files.end());
+    for (const fs::path& file : files) {
+        const auto text = sgl::read_file_to_string(file.string());
+        if (!text) {
+            fail("Failed to read %s", file.string().c_str());
+            continue;
+        }
+        size_t pos = 0;
+        while ((pos = text->find_first_not_of(" \t\r\n", pos)) != std::string::npos) {
+            const size_t last = std::min(text->find_first_of(" \t\r\n", pos), text->size());
+            tokens.emplace(*text, pos, last - pos);
+            pos = last;
+        }
+    }
+    for (const std::string& token : tokens)
+        check_float(token);
+    const size_t model_tokens = num_tokens / 3, model_accepted = num_accepted;
+    if (model_accepted == 0)
+        fail("No token of the model files was parsed without from_chars");
+
+    // signs, missing integer or fraction digits, the 15 characters of the SIMD window, the 19 digits
+    // of the scalar loop, and decimals that round to double exactly halfway between two floats
+    for (const char* token : { "0", "-0", "0.0", "-0.000000", ".5", "-.5", "5.", "-5.", "1.000000", "-1.000000",
+                               "123456789012345", "-12345678.901234", "1234567.1234567", "0.0000000000001",
+                               "9999999999999999999", "0.999999999999999999", "0.1", "0.3", "3.4028235", "16777217",
+                               "16777219", "33554434", "0.000000059604645", "1.17549435", "340282346638528859811",
+                               "4.077673673629761", "-8.028053760528564", "1.90711909532547", "651.7818908691406",
+                               "1.687670648097992" })
+        check_float(token);
+
+    // exponents, hex floats, specials, an explicit plus sign and other forms from_chars is left with
+    for (const char* token : { "1e5", "1.5e-3", "-2.5E+10", "1e", ".e1", "inf", "-inf", "nan", "0x1p3", "+1.0", "+.5",
+                               "-", ".", "-.", "", "1.2.3", "1-2", "1/2/3", "12345678901234567890", "1.0f" })
+        expect_fallback(token);
+
+    // random fixed-format numbers of every length the SIMD window fits
+    std::mt19937 rng(1234);
+    char buffer[32];
+    for (int i = 0; i < 1000000; i++) {
+        const int decimals = int(rng() % 12);
+        const double magnitude = std::ldexp(double(rng()), int(rng() % 40) - 40);
+        const int length = std::snprintf(buffer, sizeof(buffer), "%.*f", decimals, (rng() & 1) ? -magnitude : magnitude);
+        check_float({ buffer, size_t(length) });
+    }
+
+    std::printf("floats: %zu distinct model tokens, %zu accepted without from_chars\n", model_tokens, model_accepted / 3);
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MAIN
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+    if (argc < 2) {
+        std::fprintf(stderr, "Usage: %s <check> [models_dir]\n", argv[0]);
+        return 2;
+    }
+    const std::string_view check = argv[1];
+    const fs::path models_dir = argc > 2 ? argv[2] : "3D_Models";
+
+    spdlog::set_default_logger(spdlog::stderr_color_mt("test"));
+    spdlog::set_level(spdlog::level::warn);
+
+    if (check == "half")
+        check_half();
+    else if (check == "parallel")
+        check_parallel(models_dir);
+    else if (check == "floats")
+        check_floats(models_dir);
+    else {
+        std::fprintf(stderr, "Unknown check %s\n", argv[1]);
+        return 2;
+    }
+
+    if (num_failures) {
+        std::fprintf(stderr, "%s: %u failures\n", argv[1], num_failures);
+        return 1;
+    }
+    std::printf("%s: ok\n", argv[1]);
+    return 0;
+}
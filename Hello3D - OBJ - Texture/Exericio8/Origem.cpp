@@ -33,6 +33,9 @@ using namespace std;
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+// SGL (OBJ loader)
+#include <sgl_assets.hpp>
+
 
 // Prottipo da funo de callback de teclado
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
@@ -74,116 +77,42 @@ struct Material {
     std::string texture_path;
 };
 
-auto parse_mtl(const std::string& filename) -> std::optional<Material>
-{
-    auto file = std::ifstream(filename);
-    if (!file.good()) {
-        cerr << "Error opening MTL file '" << filename
-             << "', error: " << std::strerror(errno) << endl;
-        return std::nullopt;
-    }
-
-    Material material;
-    char buf[BUFSIZ];
-    while (file.getline(buf, sizeof(buf))) {
-        std::stringstream ss(buf);
-        std::string code;
-        ss >> code;
-        if (code == "map_Kd") {
-            std::string texture;
-            ss >> texture;
-            Material material;
-            material.texture_path = std::filesystem::path(filename).remove_filename().append(texture).string();
-            return material;
-        }
-    }
-
-    return std::nullopt;
-}
-
 struct Vertex {
     glm::vec3 position;
     glm::vec2 texcoord;
 };
 
 struct Obj {
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> texcoords;
-    std::vector<glm::u32vec3> triangle_indices;
-    std::vector<Vertex> vertices;
+    std::vector<Vertex> vertices; // 3 per triangle
     Material material;
 };
 
 auto parse_obj(const std::string& filename) -> std::optional<Obj>
 {
-    auto file = std::ifstream(filename);
-    if (!file.good()) {
-        cerr << "Error opening OBJ file '" << filename
-             << "', error: " << std::strerror(errno) << endl;
+    sgl::ModelLoadOptions options;
+    options.cache = false; // vertices are expanded below, not uploaded from a cooked file
+    options.lod_levels = 0;
+    sgl::ModelRef model = sgl::parse_model(filename, options);
+    if (!model) {
+        cerr << "Error loading OBJ file '" << filename << "'" << endl;
         return std::nullopt;
     }
 
     Obj obj;
-    char buf[BUFSIZ];
-    while (file.getline(buf, sizeof(buf))) {
-        std::stringstream ss(buf);
-        std::string code;
-        ss >> code;
-        if (code == "v") {
-            glm::vec3 v;
-            ss >> v.x; ss >> v.y; ss >> v.z;
-            obj.positions.push_back(v);
-        }
-        else if (code == "vn") {
-            glm::vec3 vn;
-            ss >> vn.x >> vn.y >> vn.z;
-            obj.normals.push_back(vn);
-        }
-        else if (code == "vt") {
-            glm::vec2 vt;
-            ss >> vt.x; ss >> vt.y;
-            obj.texcoords.push_back(vt);
-        }
-        else if (code == "f") {
-            glm::u32vec3 fv; // positions
-            glm::u32vec3 fvt; // textcoord
-            glm::u32vec3 fvn; // normal
-            ss >> fv[0]; ss.get() /*slash*/; ss >> fvt[0]; ss.get() /*slash*/; ss >> fvn[0];
-            ss >> fv[1]; ss.get() /*slash*/; ss >> fvt[1]; ss.get() /*slash*/; ss >> fvn[1];
-            ss >> fv[2]; ss.get() /*slash*/; ss >> fvt[2]; ss.get() /*slash*/; ss >> fvn[2];
-            fv -= glm::u32vec3(1); /* index is offset by 1 */
-            fvt -= glm::u32vec3(1); /* index is offset by 1 */
-            fvn -= glm::u32vec3(1); /* index is offset by 1 */
-            obj.triangle_indices.push_back(fv);
-            Vertex v0;
-            v0.position = obj.positions[fv[0]];
-            v0.texcoord = obj.texcoords[fvt[0]];
-            obj.vertices.push_back(v0);
-            Vertex v1;
-            v1.position = obj.positions[fv[1]];
-            v1.texcoord = obj.texcoords[fvt[1]];
-            obj.vertices.push_back(v1);
-            Vertex v2;
-            v2.position = obj.positions[fv[2]];
-            v2.texcoord = obj.texcoords[fvt[2]];
-            obj.vertices.push_back(v2);
-        }
-        else if (code == "mtllib") {
-            std::string mtllib_str;
-            ss >> mtllib_str;
-            auto mtlpath = std::filesystem::path(filename).remove_filename().append(mtllib_str).string();
-            auto mtl = parse_mtl(mtlpath);
-            if (!mtl) {
-                cerr << "Failed to read MTL file: " << mtlpath << endl;
-                return std::nullopt;
-            }
-            obj.material = *mtl;
+    const sgl::Mesh& mesh = model->mesh;
+    for (unsigned int index : mesh.indices) {
+        const float* v = &mesh.vertices[index * sgl::Mesh::kFloatsPerVertex];
+        obj.vertices.push_back({ glm::make_vec3(v), glm::make_vec2(v + 3) });
+    }
+    for (const sgl::MaterialRef& material : model->materials) {
+        if (!material->diffuse_map.empty()) {
+            obj.material.texture_path = material->diffuse_map;
+            break;
         }
     }
 
-    printf("Parsed OBJ file '%s' with %zu positions, %zu normals, %zu texcoords, %zu triangles and %zu vertices\n",
-           filename.c_str(), obj.positions.size(), obj.normals.size(), obj.texcoords.size(), obj.triangle_indices.size(), obj.vertices.size());
+    printf("Parsed OBJ file '%s' with %zu unique vertices, %zu triangles and %zu vertices\n",
+           filename.c_str(), mesh.num_vertices(), mesh.indices.size() / 3, obj.vertices.size());
 
     return obj;
 }
@@ -28,6 +28,9 @@ using namespace std;
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// SGL (OBJ loader)
+#include <sgl_assets.hpp>
+
 
 // Prottipo da funo de callback de teclado
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode);
@@ -65,53 +68,29 @@ bool rotateX=false, rotateY=false, rotateZ=false;
 
 struct Obj {
     std::vector<glm::vec3> vertices;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> texcoords;
     std::vector<glm::u32vec3> triangle_indices;
 };
 
 auto parse_obj(const std::string& filename) -> std::optional<Obj>
 {
-    auto file = std::ifstream(filename);
-    if (!file.good()) {
-        cerr << "Error opening OBJ file '" << filename
-             << "', error: " << std::strerror(errno) << endl;
+    sgl::ModelLoadOptions options;
+    options.cache = false; // vertices and indices are copied below, not uploaded from a cooked file
+    options.lod_levels = 0;
+    sgl::ModelRef model = sgl::parse_model(filename, options);
+    if (!model) {
+        cerr << "Error loading OBJ file '" << filename << "'" << endl;
+        return std::nullopt;
     }
 
     Obj obj;
-    char buf[BUFSIZ];
-    while (file.getline(buf, sizeof(buf))) {
-        std::stringstream ss(buf);
-        std::string code;
-        ss >> code;
-        if (code == "v") {
-            glm::vec3 v;
-            ss >> v.x; ss >> v.y; ss >> v.z;
-            obj.vertices.push_back(v);
-        }
-        else if (code == "vn") {
-            glm::vec3 vn;
-            ss >> vn.x; ss >> vn.y; ss >> vn.z;
-            obj.normals.push_back(vn);
-        }
-        else if (code == "vt") {
-            glm::vec2 vt;
-            ss >> vt.x; ss >> vt.y;
-            obj.texcoords.push_back(vt);
-        }
-        else if (code == "f") {
-            uint32_t _; // dummy var
-            glm::u32vec3 fv; // get only vertex indices for now
-            ss >> fv[0]; ss.get() /*slash*/; ss >> _; ss.get() /*slash*/; ss >> _;
-            ss >> fv[1]; ss.get() /*slash*/; ss >> _; ss.get() /*slash*/; ss >> _;
-            ss >> fv[2]; ss.get() /*slash*/; ss >> _; ss.get() /*slash*/; ss >> _;
-            fv -= glm::u32vec3(1); /* index is offset by 1 */
-            obj.triangle_indices.push_back(fv);
-        }
-    }
-
-    printf("Parsed OBJ file '%s' with %zu vertices, %zu normals, %zu texcoords, %zu triangles\n",
-           filename.c_str(), obj.vertices.size(), obj.normals.size(), obj.texcoords.size(), obj.triangle_indices.size());
+    const sgl::Mesh& mesh = model->mesh;
+    for (size_t v = 0; v < mesh.num_vertices(); v++)
+        obj.vertices.push_back(glm::make_vec3(&mesh.vertices[v * sgl::Mesh::kFloatsPerVertex])); // position only
+    for (size_t i = 0; i + 2 < mesh.indices.size(); i += 3)
+        obj.triangle_indices.push_back({ mesh.indices[i], mesh.indices[i + 1], mesh.indices[i + 2] });
+
+    printf("Parsed OBJ file '%s' with %zu vertices, %zu triangles\n",
+           filename.c_str(), obj.vertices.size(), obj.triangle_indices.size());
 
     return obj;
 }
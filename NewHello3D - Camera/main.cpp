@@ -10,7 +10,7 @@ int main(int argc, char *argv[])
 {
     Window window = init_window(800, 800, "Visualizador 3D");
     ModelRef model = load_model("../../3D_Models/Suzanne/SuzanneTriTextured.obj");
-    Object suzanne = create_mesh(model->meshes[0]);
+    Object suzanne = create_mesh(model->mesh);
     suzanne.scale(0.5f);
 
     Object plane = create_quad().color(GRAY);
@@ -16,37 +16,18 @@
 #include <spdlog/spdlog.h>
 #include <spdlog/sinks/stdout_color_sinks.h>
 
+#include "sgl_assets.hpp"
+
 #include <GLFW/glfw3.h>
 
 /// Simple Graphics Library
 namespace sgl {
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// LOG
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
-#define TRACE SPDLOG_TRACE
-#define DEBUG SPDLOG_DEBUG
-#define INFO SPDLOG_INFO
-#define WARN SPDLOG_WARN
-#define ERROR SPDLOG_ERROR
-#define CRITICAL SPDLOG_CRITICAL
-#define ABORT_MSG(...) do { CRITICAL(__VA_ARGS__); std::abort(); } while (0)
-#define ASSERT_MSG(expr, ...) do { if (expr) { } else { ABORT_MSG(__VA_ARGS__); } } while (0)
-#define ASSERT(expr) ASSERT_MSG(expr, "Assertion failed: ({})", #expr)
-#define ASSERT_RET(expr) [&]{ auto ret = (expr); ASSERT_MSG(ret, "Assertion failed: ({})", #expr); return ret; }()
-#define DBG(expr) [&]{ auto ret = (expr); DEBUG("({}) = {{{}}}", #expr, ret); return ret; }()
-
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // UTILS
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Default core reference type
-template<typename ...T>
-using Ref = std::shared_ptr<T...>;
-
 /// Utility type to make unique numbers (IDs) movable, when moved the value should be zero
 template<typename T>
 struct UniqueNum final {
@@ -60,9 +41,6 @@ struct UniqueNum final {
   operator T() const { return inner; }
 };
 
-/// Read file contents to a string
-auto read_file_to_string(const std::string& filename) -> std::optional<std::string>;
-
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // COLORS
@@ -204,46 +182,16 @@ struct GLTexture final {
     Ref<GLTexture> to_ref() { return std::make_shared<GLTexture>(std::move(*this)); }
 };
 
-using GLTextureRef = Ref<GLTexture>;
-
 /// Load a texture file from give path into GPU memory
 GLTextureRef load_texture(std::string_view path, GLenum filter);
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// MATERIAL
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
-struct Material {
-    float ka = 1.0f;
-    float kd = 1.0f;
-    float ks = 1.0f;
-    float q  = 1.0f;
-    GLTextureRef diffuse_tex;
-
-    Ref<Material> to_ref() { return std::make_shared<Material>(std::move(*this)); }
-};
-using MaterialRef = Ref<Material>;
-
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // MESH/MODEL
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Represents one mesh with its vertices and material
-struct Mesh {
-    std::vector<float> vertices;
-    MaterialRef material;
-};
-
-/// Represents a loaded Model file with multiple meshes
-struct Model {
-    Mesh meshes[1]; // support only 1 mesh for now
-};
-using ModelRef = Ref<Model>;
-
 /// Load an OBJ model meshes and materials from file
-ModelRef load_model(std::string_view filepath);
+ModelRef load_model(std::string_view filepath, const ModelLoadOptions& options = {});
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
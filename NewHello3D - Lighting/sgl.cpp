@@ -1,9 +1,5 @@
 #include "sgl.hpp"
 
-#include <sstream>
-#include <fstream>
-#include <filesystem>
-
 #include <GLFW/glfw3.h>
 
 #include <spdlog/spdlog.h>
@@ -22,19 +18,6 @@ namespace sgl {
 // UTILS
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Read file contents to a string
-auto read_file_to_string(const std::string& filename) -> std::optional<std::string>
-{
-    std::string string;
-    std::fstream fstream(filename, std::ios::in | std::ios::binary);
-    if (!fstream) { ERROR("{} ({})", std::strerror(errno), filename); return std::nullopt; }
-    fstream.seekg(0, std::ios::end);
-    string.reserve(fstream.tellg());
-    fstream.seekg(0, std::ios::beg);
-    string.assign((std::istreambuf_iterator<char>(fstream)), std::istreambuf_iterator<char>());
-    return string;
-}
-
 /// Convert primitive type to GL constant
 template<typename T> 
 struct GLType;
@@ -318,122 +301,17 @@ void load_white_texture()
 // MESH/MODEL
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Load first Material from a MTL file
-static auto load_mtl(const std::string& filename) -> std::optional<Material>
-{
-    auto file = std::ifstream(filename);
-    if (!file.good()) {
-        ERROR("Error opening MTL file '{}', error: {}", filename.data(), std::strerror(errno));
-        return std::nullopt;
-    }
-
-    Material material{};
-    char buf[BUFSIZ];
-    while (file.getline(buf, sizeof(buf))) {
-        std::stringstream ss(buf);
-        std::string code;
-        ss >> code;
-        if (code == "map_Kd") {
-            std::string texture;
-            ss >> texture;
-            auto tex_path = std::filesystem::path(filename).remove_filename().append(texture).string();
-            material.diffuse_tex = load_texture(tex_path, GL_LINEAR);
-        }
-        else if (code == "Ns") {
-            float ns;
-            ss >> ns;
-            material.q = ns;
-        }
-        else if (code == "Ka") {
-            float ka, dummy;
-            ss >> ka >> dummy >> dummy;
-            material.ka = ka;
-        }
-        else if (code == "Kd") {
-            float kd, dummy;
-            ss >> kd >> dummy >> dummy;
-            material.kd = kd;
-        }
-        else if (code == "Ks") {
-            float ks, dummy;
-            ss >> ks >> dummy >> dummy;
-            material.ks = ks;
-        }
-    }
-
-    return material;
-}
-
 /// Load an OBJ model meshes and materials from file
-ModelRef load_model(std::string_view filepath)
+ModelRef load_model(std::string_view filepath, const ModelLoadOptions& options)
 {
-    auto file = std::ifstream(filepath.data());
-    if (!file.good()) {
-        ERROR("Failed to open OBJ file {}, error: {}", filepath.data(), std::strerror(errno));
+    ModelRef model = parse_model(filepath, options);
+    if (!model)
         return nullptr;
+    for (const MaterialRef& material : model->materials) {
+        if (!material->diffuse_map.empty())
+            material->diffuse_tex = load_texture(material->diffuse_map, GL_LINEAR);
     }
-
-    Model model;
-    Mesh* curr_mesh = &model.meshes[0];
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> texcoords;
-
-    char buf[BUFSIZ];
-    while (file.getline(buf, sizeof(buf))) {
-        std::stringstream ss(buf);
-        std::string code;
-        ss >> code;
-        if (code == "v") {
-            glm::vec3 v;
-            ss >> v.x; ss >> v.y; ss >> v.z;
-            positions.push_back(v);
-        }
-        else if (code == "vn") {
-            glm::vec3 vn;
-            ss >> vn.x >> vn.y >> vn.z;
-            normals.push_back(vn);
-        }
-        else if (code == "vt") {
-            glm::vec2 vt;
-            ss >> vt.x; ss >> vt.y;
-            texcoords.push_back(vt);
-        }
-        else if (code == "f") {
-            glm::u32vec3 fv; // positions
-            glm::u32vec3 fvt; // textcoord
-            glm::u32vec3 fvn; // normal
-            ss >> fv[0]; ss.get() /*slash*/; ss >> fvt[0]; ss.get() /*slash*/; ss >> fvn[0];
-            ss >> fv[1]; ss.get() /*slash*/; ss >> fvt[1]; ss.get() /*slash*/; ss >> fvn[1];
-            ss >> fv[2]; ss.get() /*slash*/; ss >> fvt[2]; ss.get() /*slash*/; ss >> fvn[2];
-            fv -= glm::u32vec3(1); /* index is offset by 1 */
-            fvt -= glm::u32vec3(1); /* index is offset by 1 */
-            fvn -= glm::u32vec3(1); /* index is offset by 1 */
-            for (int i : {0, 1, 2}) {
-                curr_mesh->vertices.push_back(positions[fv[i]].x);
-                curr_mesh->vertices.push_back(positions[fv[i]].y);
-                curr_mesh->vertices.push_back(positions[fv[i]].z);
-                curr_mesh->vertices.push_back(texcoords[fvt[i]].s);
-                curr_mesh->vertices.push_back(texcoords[fvt[i]].t);
-                curr_mesh->vertices.push_back(normals[fvn[i]].x);
-                curr_mesh->vertices.push_back(normals[fvn[i]].y);
-                curr_mesh->vertices.push_back(normals[fvn[i]].z);
-            }
-        }
-        else if (code == "mtllib") {
-            std::string mtllib_str;
-            ss >> mtllib_str;
-            auto mtlpath = std::filesystem::path(filepath).remove_filename().append(mtllib_str).string();
-            auto mtl = load_mtl(mtlpath);
-            if (!mtl) {
-                ERROR("Failed to read MTL file: {}", mtlpath);
-                return nullptr;
-            }
-            curr_mesh->material = mtl->to_ref();
-        }
-    }
-
-    return std::make_shared<Model>(std::move(model));
+    return model;
 }
 
 
@@ -968,18 +846,27 @@ Object create_texture_rect(Size2 size, GLTextureRef texture, Rect r, GLenum usag
 }
 
 /// Create a mesh object with texture loaded into GPU buffers
+/// (drawn in a single call with the material of the first submesh, levels of detail are not used)
 Object create_mesh(const Mesh& mesh, GLenum usage)
 {
-    constexpr auto kFloatsPerVertex = 3 + 2 + 3;
-    auto va = VertexArray(mesh.vertices.size() / kFloatsPerVertex)
-        .add_buffer(mesh.vertices.data())
+    // full detail submeshes are at the start of the index buffer, levels of detail follow
+    size_t num_indices = 0;
+    for (const SubMesh& submesh : mesh.submeshes)
+        num_indices = std::max(num_indices, submesh.index_offset + submesh.index_count);
+
+    auto va = VertexArray(mesh.num_vertices())
+        .add_buffer(mesh.cooked ? mesh.cooked->vertices : mesh.vertices.data())
         .add_attr<float>(GLAttr::POSITION, 3)
         .add_attr<float>(GLAttr::TEXCOORD, 2)
         .add_attr<float>(GLAttr::NORMAL, 3);
+    if (mesh.cooked)
+        va.add_indices_args((void*)mesh.cooked->indices, num_indices, mesh.cooked->index_type, index_type_size(mesh.cooked->index_type));
+    else
+        va.add_indices(mesh.indices.data(), num_indices);
 
     auto obj = Object().glo(create_globject(va, usage).to_ref());
-    if (mesh.material)
-        obj.material(*mesh.material);
+    if (!mesh.submeshes.empty() && mesh.submeshes[0].material)
+        obj.material(*mesh.submeshes[0].material);
     return obj;
 }
 
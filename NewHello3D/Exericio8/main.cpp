@@ -12,6 +12,10 @@ const float PI = 3.14159265359;
 void key_callback(GLFWwindow* window, int key, int scancode, int action, int mode, void* cookie);
 auto generateCirclePointsSet() -> std::vector<glm::vec3>;
 auto generateUnisinosPointsSet() -> std::vector<glm::vec3>;
+void bench_texture_uploads();
+void bench_render_queue();
+void bench_instancing();
+void bench_static_batching();
 
 // Global variables
 glm::vec3 rotate_vector = {0.f, 1.f, 0.f};
@@ -21,36 +25,51 @@ int main(int argc, char *argv[])
 {
     // Context
     Window window = init_window(800, 800, "Visualizador 3D");
+    if (argc > 1 && std::string_view(argv[1]) == "--bench-uploads") {
+        bench_texture_uploads();
+        return 0;
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--bench-queue") {
+        bench_render_queue();
+        return 0;
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--bench-instancing") {
+        bench_instancing();
+        return 0;
+    }
+    if (argc > 1 && std::string_view(argv[1]) == "--bench-batching") {
+        bench_static_batching();
+        return 0;
+    }
     set_key_callback(key_callback, nullptr);
     set_camera_control(true);
+    set_hot_reload(true); // re-exported models and textures show up without restarting
+    set_virtual_texture_threshold(2048); // stream the large planet textures by tiles
     std::vector<Object*> objects;  // list of objects
 
-    // Objects
-    ModelRef model = load_model("../../3D_Models/Suzanne/SuzanneTriTextured.obj");
-    Object suzanne = create_mesh(model->meshes[0]);
+    // Objects (loaded in background, each one shows up as soon as it is ready)
+    Object suzanne = create_mesh_async(load_model_async("../../3D_Models/Suzanne/SuzanneTriTextured.obj"));
     suzanne.scale(0.5f);
     objects.push_back(&suzanne);
 
-    model = load_model("../../3D_Models/Suzanne/CuboTextured.obj");
-    Object bola = create_mesh(model->meshes[0]);
+    Object bola = create_mesh_async(load_model_async("../../3D_Models/Suzanne/CuboTextured.obj"));
     bola.scale(0.4f);
     bola.position({ -1.4f, 0.f, 0.f });
     objects.push_back(&bola);
 
-    model = load_model("../../3D_Models/Planetas/planeta.obj");
-    Object planeta = create_mesh(model->meshes[0]);
+    Object planeta = create_mesh_async(load_model_async("../../3D_Models/Planetas/planeta.obj"));
     planeta.scale(0.4f);
     glm::vec3 planeta_position = { +1.8f, 0.3f, 1.8f };
     planeta.position(planeta_position);
     objects.push_back(&planeta);
 
-    Object plane = create_quad().color(GRAY);
+    Object plane = create_quad().color(GRAY).make_static();
     plane.scale(3.f);
     plane.rotate({PI/2, 0.f, 0.f});
     plane.position({0.f, -1.0f, 0.f});
     objects.push_back(&plane);
 
-    Object cube = create_cuboid(Size3(1.f)).color(WHITE);
+    Object cube = create_cuboid(Size3(1.f)).color(WHITE).make_static();
     cube.position({-0.5f, -0.5f, -0.5f});
     objects.push_back(&cube);
 
@@ -70,6 +89,8 @@ int main(int argc, char *argv[])
     int j = 0;
 
     // loop
+    RenderQueue queue;
+    StaticBatcher batcher;
     while (!window_should_close()) {
 
         // update
@@ -85,8 +106,13 @@ int main(int argc, char *argv[])
 
         // render
         begin_render(DARK_GRAY);
-        for (auto obj : objects)
-            draw_object(*obj);
+        batcher.update(objects);
+        batcher.submit(queue);
+        for (auto obj : objects) {
+            if (!batcher.contains(*obj))
+                queue.submit(*obj);
+        }
+        queue.flush();
         end_render();
     }
 
@@ -111,6 +137,193 @@ void key_callback(GLFWwindow* window, int key, int scancode, int action, int mod
 }
 
 
+// Compare texture upload latency with and without pixel buffers: time blocked in the upload
+// calls on the render thread, and until the GPU has the texture (glFinish)
+void bench_texture_uploads()
+{
+    const char* paths[] = { "../../3D_Models/Planetas/Terra.jpg", "../../3D_Models/Planetas/2k_mercury.jpg" };
+    const int runs = 20;
+    const int stream_size = 1024;
+    std::vector<uint8_t> pixels(stream_size * stream_size * 4);
+
+    for (bool pixel_buffers : { false, true }) {
+        set_pixel_buffer_uploads(pixel_buffers);
+        const char* mode = pixel_buffers ? "pixel buffers" : "direct";
+        for (const char* path : paths) {
+            double call = 0, done = 0;
+            for (int run = 0; run < runs; run++) {
+                const double start = get_time();
+                GLTextureRef texture = load_texture(path, GL_LINEAR); // from the texture cache after the first run
+                call += get_time() - start;
+                glFinish();
+                done += get_time() - start;
+            }
+            std::printf("%-14s %-40s call %7.3f ms  done %7.3f ms\n", mode, path, call / runs * 1e3, done / runs * 1e3);
+        }
+
+        GLTextureRef stream = create_stream_texture(stream_size, stream_size, GL_LINEAR);
+        double call = 0, done = 0;
+        for (int frame = 0; frame < runs; frame++) {
+            std::fill(pixels.begin(), pixels.end(), uint8_t(frame * 8));
+            const double start = get_time();
+            update_stream_texture(*stream, 0, 0, stream_size, stream_size, pixels.data());
+            call += get_time() - start;
+            glFinish();
+            done += get_time() - start;
+        }
+        std::printf("%-14s %-40s call %7.3f ms  done %7.3f ms\n", mode, "stream texture 1024x1024", call / runs * 1e3, done / runs * 1e3);
+    }
+}
+
+
+// Compare GL state changes and frame time drawing a scene of hundreds of objects, mixing models,
+// textures and colors, one object at a time in scene order or sorted through a RenderQueue
+void bench_render_queue()
+{
+    const char* paths[] = { "../../3D_Models/Suzanne/SuzanneTriTextured.obj", "../../3D_Models/Suzanne/CuboTextured.obj",
+                            "../../3D_Models/Planetas/planeta.obj" };
+    const Color colors[] = { WHITE, GRAY, Color(1.f, 0.6f, 0.6f), Color(0.6f, 0.6f, 1.f) };
+    const int side = 20;
+    const int frames = 100;
+
+    std::vector<Object> objects;
+    std::vector<Object> models;
+    for (const char* path : paths) {
+        if (ModelRef model = load_model(path))
+            models.push_back(create_mesh(model->mesh));
+    }
+    models.push_back(create_cuboid(Size3(1.f)));
+    for (int i = 0; i < side * side; i++) {
+        Object obj = models[i % models.size()];
+        obj.color(colors[(i / models.size()) % std::size(colors)]);
+        obj.scale(0.1f);
+        obj.position({ (i % side - side / 2) * 0.3f, (i / side - side / 2) * 0.3f, -4.f });
+        objects.push_back(std::move(obj));
+    }
+
+    RenderQueue queue;
+    for (bool sorted : { false, true }) {
+        RenderStats stats;
+        double time = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            const double start = get_time();
+            begin_render(DARK_GRAY);
+            for (const Object& obj : objects) {
+                if (sorted)
+                    queue.submit(obj);
+                else
+                    draw_object(obj);
+            }
+            queue.flush();
+            stats = get_render_stats();
+            glFinish();
+            time += get_time() - start;
+            end_render();
+        }
+        std::printf("%-10s %zu objects  draw calls %5zu  state changes %5zu  texture binds %4zu  frame %7.3f ms\n",
+                    sorted ? "queue" : "immediate", objects.size(), stats.draw_calls, stats.state_changes,
+                    stats.texture_binds, time / frames * 1e3);
+    }
+}
+
+
+// Frame time of a grid of spinning cubes drawn with one instanced call, and with one draw per cube
+// through a RenderQueue (fewer cubes, it is much slower)
+void bench_instancing()
+{
+    const int frames = 120;
+    Object cube = create_cuboid(Size3(1.f));
+
+    for (auto [instanced, count] : { std::pair{ true, 100000 }, std::pair{ false, 10000 } }) {
+        const int side = int(std::ceil(std::sqrt(count)));
+        std::vector<Transform> transforms(count);
+        std::vector<Color> colors(count);
+        for (int i = 0; i < count; i++) {
+            transforms[i].position = Pos3((i % side - side / 2) * 0.15f, (i / side - side / 2) * 0.15f, -side * 0.1f);
+            transforms[i].scale = Size3(0.1f);
+            colors[i] = Color(float(i % side) / side, float(i / side) / side, 0.5f);
+        }
+        std::vector<Object> objects(instanced ? 0 : count, cube);
+        RenderQueue queue;
+
+        double time = 0;
+        for (int frame = 0; frame < frames; frame++) {
+            const double start = get_time();
+            begin_render(DARK_GRAY);
+            for (int i = 0; i < count; i++)
+                transforms[i].rotation = glm::vec3(float(start) + i * 0.01f);
+            if (instanced) {
+                draw_instanced(*cube.m_glo, transforms, colors);
+            } else {
+                for (int i = 0; i < count; i++) {
+                    objects[i].transform(transforms[i]).color(colors[i]);
+                    queue.submit(objects[i]);
+                }
+                queue.flush();
+            }
+            glFinish();
+            time += get_time() - start;
+            end_render();
+        }
+        const double frame_ms = time / frames * 1e3;
+        std::printf("%-10s %6d cubes  draw calls %6zu  frame %8.3f ms  %6.1f fps\n", instanced ? "instanced" : "per object",
+                    count, get_render_stats().draw_calls, frame_ms, 1e3 / frame_ms);
+    }
+}
+
+
+// Draw calls and frame time of a scene made of a thousand static primitives, drawn one by one
+// through a RenderQueue and merged by a StaticBatcher
+void bench_static_batching()
+{
+    const int side = 32;
+    const int frames = 120;
+    Color face_colors[6] = { WHITE, GRAY, Color(1.f, 0.6f, 0.6f), Color(0.6f, 1.f, 0.6f), Color(0.6f, 0.6f, 1.f), DARK_GRAY };
+    const Color colors[] = { WHITE, GRAY, Color(1.f, 0.6f, 0.6f), Color(0.6f, 0.6f, 1.f) };
+
+    std::vector<Object> scene;
+    for (int i = 0; i < side * side; i++) {
+        Object obj = i % 3 == 0 ? create_cuboid(Size3(1.f)).color(colors[i % std::size(colors)])
+                   : i % 3 == 1 ? create_color_cuboid(Size3(1.f), face_colors)
+                   : create_rect(Size2(1.f, 1.f)).color(colors[i % std::size(colors)]);
+        obj.make_static().scale(0.05f).rotate(glm::vec3(i * 0.1f));
+        obj.position({ (i % side - side / 2) * 0.15f, (i / side - side / 2) * 0.15f, -5.f });
+        scene.push_back(std::move(obj));
+    }
+    std::vector<Object*> objects;
+    for (Object& obj : scene)
+        objects.push_back(&obj);
+
+    RenderQueue queue;
+    StaticBatcher batcher;
+    for (bool batched : { false, true }) {
+        double time = 0;
+        const double build_start = get_time();
+        if (batched)
+            batcher.update(objects);
+        const double build = get_time() - build_start;
+        for (int frame = 0; frame < frames; frame++) {
+            const double start = get_time();
+            begin_render(DARK_GRAY);
+            if (batched)
+                batcher.update(objects); // unchanged, no rebuild
+            batcher.submit(queue);
+            for (Object* obj : objects) {
+                if (!batcher.contains(*obj))
+                    queue.submit(*obj);
+            }
+            queue.flush();
+            glFinish();
+            time += get_time() - start;
+            end_render();
+        }
+        std::printf("%-10s %zu objects  batches %3zu (built in %6.3f ms)  draw calls %5zu  frame %7.3f ms\n",
+                    batched ? "batched" : "unbatched", objects.size(), batcher.num_batches(), build * 1e3,
+                    get_render_stats().draw_calls, time / frames * 1e3);
+    }
+}
+
+
 std::vector<glm::vec3> generateCirclePointsSet()
 {
     std::vector<glm::vec3> vertices;
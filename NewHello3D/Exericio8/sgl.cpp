@@ -1,8 +1,25 @@
 #include "sgl.hpp"
 
-#include <sstream>
-#include <fstream>
 #include <filesystem>
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+#include <limits>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <numeric>
+#include <thread>
+#include <tuple>
+#include <variant>
+
+#if defined(__linux__)
+#include <cerrno>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
 
 #include <GLFW/glfw3.h>
 
@@ -22,19 +39,6 @@ namespace sgl {
 // UTILS
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Read file contents to a string
-auto read_file_to_string(const std::string& filename) -> std::optional<std::string>
-{
-    std::string string;
-    std::fstream fstream(filename, std::ios::in | std::ios::binary);
-    if (!fstream) { ERROR("{} ({})", std::strerror(errno), filename); return std::nullopt; }
-    fstream.seekg(0, std::ios::end);
-    string.reserve(fstream.tellg());
-    fstream.seekg(0, std::ios::beg);
-    string.assign((std::istreambuf_iterator<char>(fstream)), std::istreambuf_iterator<char>());
-    return string;
-}
-
 /// Convert primitive type to GL constant
 template<typename T> 
 struct GLType;
@@ -54,6 +58,126 @@ template<>
 struct GLType<unsigned short> { static constexpr auto value = GL_UNSIGNED_SHORT; };
 template<> 
 struct GLType<const unsigned short> { static constexpr auto value = GL_UNSIGNED_SHORT; };
+template<> 
+struct GLType<short> { static constexpr auto value = GL_SHORT; };
+template<> 
+struct GLType<const short> { static constexpr auto value = GL_SHORT; };
+
+template<> 
+struct GLType<Half> { static constexpr auto value = GL_HALF_FLOAT; };
+template<> 
+struct GLType<const Half> { static constexpr auto value = GL_HALF_FLOAT; };
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LOADER
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+/// Fixed set of worker threads running submitted jobs in order
+class ThreadPool final {
+  public:
+    explicit ThreadPool(unsigned num_threads) {
+        for (unsigned i = 0; i < num_threads; i++)
+            threads_.emplace_back([this] { work(); });
+    }
+
+    /// Wait for running jobs to finish, pending jobs are discarded
+    ~ThreadPool() {
+        {
+            std::lock_guard lock(mutex_);
+            stop_ = true;
+            jobs_.clear();
+        }
+        cond_.notify_all();
+        for (auto& thread : threads_)
+            thread.join();
+    }
+
+    void submit(std::function<void()> job) {
+        {
+            std::lock_guard lock(mutex_);
+            jobs_.push_back(std::move(job));
+        }
+        cond_.notify_one();
+    }
+
+  private:
+    void work() {
+        std::unique_lock lock(mutex_);
+        while (true) {
+            cond_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+            if (stop_)
+                return;
+            auto job = std::move(jobs_.front());
+            jobs_.pop_front();
+            lock.unlock();
+            job();
+            job = nullptr; // release captures before taking the lock again
+            lock.lock();
+        }
+    }
+
+    std::vector<std::thread> threads_;
+    std::deque<std::function<void()>> jobs_;
+    std::mutex mutex_;
+    std::condition_variable cond_;
+    bool stop_ = false;
+};
+
+/// Threads reading, parsing and decoding assets in the background
+static ThreadPool& loader_pool()
+{
+    // leave a core for the render thread
+    static ThreadPool pool([] { unsigned n = std::thread::hardware_concurrency(); return n > 1 ? n - 1 : 1; }());
+    return pool;
+}
+
+/// GL calls posted by loader threads, run on the render thread each frame.
+/// A job returns false when it is not ready yet and must be retried on the next frame.
+static std::deque<std::function<bool()>> upload_queue;
+static std::mutex upload_mutex;
+static double upload_budget = 0.002; // seconds per frame
+
+/// Queue GL work to run on the render thread
+static void post_upload(std::function<bool()> job)
+{
+    std::lock_guard lock(upload_mutex);
+    upload_queue.push_back(std::move(job));
+}
+
+/// Run queued GL uploads until the frame budget is spent (at least one runs to ensure progress)
+static void process_uploads()
+{
+    using Clock = std::chrono::steady_clock;
+    const auto deadline = Clock::now() + std::chrono::duration<double>(upload_budget);
+    size_t count;
+    {
+        std::lock_guard lock(upload_mutex);
+        count = upload_queue.size();
+    }
+    // jobs posted meanwhile wait for the next frame
+    for (size_t i = 0; i < count && Clock::now() < deadline; ) {
+        std::function<bool()> job;
+        {
+            std::lock_guard lock(upload_mutex);
+            job = std::move(upload_queue.front());
+            upload_queue.pop_front();
+        }
+        if (job()) {
+            i++;
+        } else {
+            std::lock_guard lock(upload_mutex);
+            upload_queue.push_back(std::move(job));
+            count--;
+        }
+    }
+}
+
+/// Set the time spent each frame running queued GPU uploads of async loaded assets
+void set_upload_budget(double seconds)
+{
+    upload_budget = seconds;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // SHADER
@@ -181,6 +305,13 @@ const GLShader& default_shader()
     return *generic_shader;
 }
 
+/// Texture units sampled by the generic shader. Unit 0 is left to uploads, so they never disturb what is bound for drawing.
+static constexpr GLuint kUnitTextureArray = 1;
+static constexpr GLuint kUnitPageTable = 2;
+static constexpr GLuint kUnitTileCache = 3;
+static constexpr GLuint kUnitTexture2D = 4;
+static constexpr GLuint kNumTextureUnits = 5;
+
 /// Load Generic Shader
 /// (supports rendering: Colored objects adn Textured objects with Phong Lighting)
 void load_generic_shader()
@@ -198,13 +329,42 @@ out vec3 fNormal;
 uniform mat4 uModel;
 uniform mat4 uView;
 uniform mat4 uProjection;
+uniform vec3 uPositionOffset;
+uniform vec3 uPositionScale;
+uniform bool uOctahedralNormals;
+uniform bool uInstanced;
+in vec4 aInstanceRow0;
+in vec4 aInstanceRow1;
+in vec4 aInstanceRow2;
+in vec4 aInstanceColor;
+vec3 octahedral_decode(vec2 e)
+{
+    vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+    if (n.z < 0.0)
+        n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+    return normalize(n);
+}
 void main()
 {
-    gl_Position = uProjection * uView * uModel * vec4(aPosition, 1.0f);
-    fPosition = vec3(uModel * vec4(aPosition, 1.0f));
+    vec3 position = uPositionOffset + aPosition * uPositionScale;
+    vec3 normal = uOctahedralNormals ? octahedral_decode(aNormal.xy) : aNormal;
+    vec4 world;
+    if (uInstanced) {
+        mat4 model = transpose(mat4(aInstanceRow0, aInstanceRow1, aInstanceRow2, vec4(0.0, 0.0, 0.0, 1.0)));
+        mat3 m = mat3(model);
+        // cofactor matrix: the inverse transpose up to scale, without inverting per vertex
+        mat3 cofactor = mat3(cross(m[1], m[2]), cross(m[2], m[0]), cross(m[0], m[1]));
+        world = model * vec4(position, 1.0f);
+        fNormal = cofactor * normal * sign(dot(m[0], cofactor[0]));
+        fColor = aColor * aInstanceColor;
+    } else {
+        world = uModel * vec4(position, 1.0f);
+        fNormal = mat3(transpose(inverse(uModel))) * normal;
+        fColor = aColor;
+    }
+    gl_Position = uProjection * uView * world;
+    fPosition = vec3(world);
     fTexCoord = aTexCoord;
-    fColor = aColor;
-    fNormal = mat3(transpose(inverse(uModel))) * aNormal;
 }
 )";
 
@@ -216,6 +376,14 @@ in vec4 fColor;
 in vec3 fNormal;
 out vec4 outColor;
 uniform sampler2D uTexture0;
+uniform sampler2DArray uTextureArray;
+uniform int uTextureLayer; // layer of uTextureArray, -1 for uTexture0, -2 for no texture, -3 for virtual
+uniform sampler2D uPageTable;
+uniform sampler2D uTileCache;
+uniform vec2 uTileCacheSize;
+uniform int uVirtualLevels;
+uniform vec2 uVirtualLevelSize[16];
+uniform int uVirtualLevelRow[16];
 uniform float ka;
 uniform float kd;
 uniform float ks;
@@ -223,9 +391,30 @@ uniform float q;
 uniform vec3 uLightPos;
 uniform vec3 uLightColor;
 uniform vec3 uCameraPos;
+const float kTileSize = 128.0, kTileBorder = 4.0, kTileContent = 120.0;
+vec4 sample_virtual(vec2 uv)
+{
+    vec2 texels = uv * uVirtualLevelSize[0];
+    float lod = 0.5 * log2(max(dot(dFdx(texels), dFdx(texels)), dot(dFdy(texels), dFdy(texels))));
+    int level = clamp(int(floor(lod)), 0, uVirtualLevels - 1);
+    uv = clamp(uv, 0.0, 1.0);
+    vec2 tiles = ceil(uVirtualLevelSize[level] / kTileContent);
+    vec2 tile = min(floor(uv * uVirtualLevelSize[level] / kTileContent), tiles - 1.0);
+    vec4 entry = texelFetch(uPageTable, ivec2(tile) + ivec2(0, uVirtualLevelRow[level]), 0) * 255.0;
+    int mapped = int(entry.z + 0.5);
+    // the page holds the tile of the mapped level covering the middle of the wanted tile
+    vec2 center = (tile + 0.5) * kTileContent / uVirtualLevelSize[level];
+    vec2 mapped_tiles = ceil(uVirtualLevelSize[mapped] / kTileContent);
+    vec2 mapped_tile = min(floor(center * uVirtualLevelSize[mapped] / kTileContent), mapped_tiles - 1.0);
+    vec2 in_tile = clamp(uv * uVirtualLevelSize[mapped] - mapped_tile * kTileContent, -kTileBorder, kTileContent + kTileBorder);
+    return textureLod(uTileCache, (floor(entry.xy + 0.5) * kTileSize + kTileBorder + in_tile) / uTileCacheSize, 0.0);
+}
 void main()
 {
-    vec3 color = (texture(uTexture0, fTexCoord) * fColor).rgb;
+    vec4 texel = uTextureLayer >= 0 ? texture(uTextureArray, vec3(fTexCoord, uTextureLayer))
+               : uTextureLayer == -1 ? texture(uTexture0, fTexCoord)
+               : uTextureLayer == -3 ? sample_virtual(fTexCoord) : vec4(1.0);
+    vec3 color = (texel * fColor).rgb;
     vec3 ambient = ka * uLightColor;
     vec3 N = normalize(fNormal);
     vec3 L = normalize(uLightPos - fPosition);
@@ -249,6 +438,10 @@ void main()
     shader->load_attr_loc(GLAttr::TEXCOORD, "aTexCoord");
     shader->load_attr_loc(GLAttr::COLOR, "aColor");
     shader->load_attr_loc(GLAttr::NORMAL, "aNormal");
+    shader->load_attr_loc(GLAttr::INSTANCE_ROW0, "aInstanceRow0");
+    shader->load_attr_loc(GLAttr::INSTANCE_ROW1, "aInstanceRow1");
+    shader->load_attr_loc(GLAttr::INSTANCE_ROW2, "aInstanceRow2");
+    shader->load_attr_loc(GLAttr::INSTANCE_COLOR, "aInstanceColor");
     shader->load_unif_loc(GLUnif::MODEL, "uModel");
     shader->load_unif_loc(GLUnif::VIEW, "uView");
     shader->load_unif_loc(GLUnif::PROJECTION, "uProjection");
@@ -260,6 +453,22 @@ void main()
     shader->load_unif_loc(GLUnif::LIGHT_POSITION, "uLightPos");
     shader->load_unif_loc(GLUnif::LIGHT_COLOR, "uLightColor");
     shader->load_unif_loc(GLUnif::CAMERA_POSITION, "uCameraPos");
+    shader->load_unif_loc(GLUnif::POSITION_OFFSET, "uPositionOffset");
+    shader->load_unif_loc(GLUnif::POSITION_SCALE, "uPositionScale");
+    shader->load_unif_loc(GLUnif::OCTAHEDRAL_NORMALS, "uOctahedralNormals");
+    shader->load_unif_loc(GLUnif::INSTANCED, "uInstanced");
+    shader->load_unif_loc(GLUnif::TEXTURE_ARRAY, "uTextureArray");
+    shader->load_unif_loc(GLUnif::TEXTURE_LAYER, "uTextureLayer");
+    shader->load_unif_loc(GLUnif::PAGE_TABLE, "uPageTable");
+    shader->load_unif_loc(GLUnif::TILE_CACHE, "uTileCache");
+    shader->load_unif_loc(GLUnif::TILE_CACHE_SIZE, "uTileCacheSize");
+    shader->load_unif_loc(GLUnif::VIRTUAL_LEVELS, "uVirtualLevels");
+    shader->load_unif_loc(GLUnif::VIRTUAL_LEVEL_SIZE, "uVirtualLevelSize");
+    shader->load_unif_loc(GLUnif::VIRTUAL_LEVEL_ROW, "uVirtualLevelRow");
+    glUniform1i(shader->unif_loc(GLUnif::TEXTURE0), kUnitTexture2D);
+    glUniform1i(shader->unif_loc(GLUnif::TEXTURE_ARRAY), kUnitTextureArray);
+    glUniform1i(shader->unif_loc(GLUnif::PAGE_TABLE), kUnitPageTable);
+    glUniform1i(shader->unif_loc(GLUnif::TILE_CACHE), kUnitTileCache);
 
     generic_shader = std::make_shared<GLShader>(std::move(*shader));
 }
@@ -269,19 +478,401 @@ void main()
 // TEXTURE
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Load a texture file from give path into GPU memory
-GLTextureRef load_texture(std::string_view inpath, GLenum filter)
+/// Image decoded to CPU memory, ready to upload
+struct Image {
+    int width = 0, height = 0, channels = 0;
+    std::unique_ptr<unsigned char, void(*)(void*)> pixels{ nullptr, stbi_image_free };
+};
+
+/// Decode an image file to CPU memory (safe to call from any thread)
+static auto decode_image(const FileView& file, const std::string& filepath) -> std::optional<Image>
+{
+    static std::once_flag flip_once;
+    std::call_once(flip_once, [] { stbi_set_flip_vertically_on_load(true); });
+
+    Image image;
+    image.pixels.reset(stbi_load_from_memory((const uint8_t*)file.data(), file.size(), &image.width, &image.height, &image.channels, 0));
+    if (!image.pixels) { ERROR("Failed to load texture path ({})", filepath); return std::nullopt; }
+    ASSERT_MSG(image.channels == 4 || image.channels == 3, "actual channels: {}", image.channels);
+    return image;
+}
+
+/// How textures are cooked, compression is turned off at init when the GPU lacks S3TC
+static TextureCookOptions texture_options;
+
+/// Set how textures are cooked, for textures loaded afterwards
+void set_texture_options(const TextureCookOptions& options)
+{
+    texture_options = options;
+}
+
+/// Get an image file ready to upload with all its mip levels: from the texture cache when
+/// up to date, otherwise decoded, cooked and saved to the cache (safe to call from any thread)
+static auto cook_image_file(const FileView& file, const std::string& filepath) -> std::optional<CookedTexture>
+{
+    const TextureCookOptions options = texture_options;
+    if (options.cache) {
+        if (auto cooked = load_cooked_texture(filepath, options))
+            return cooked;
+    }
+    const auto image = decode_image(file, filepath);
+    if (!image)
+        return std::nullopt;
+    CookedTexture cooked = cook_texture(image->pixels.get(), image->width, image->height, image->channels, options);
+    if (options.cache)
+        save_cooked_texture(filepath, cooked, options);
+    return cooked;
+}
+
+/// Ring of pixel unpack buffers staging texture data, so the driver transfers it to the texture
+/// asynchronously instead of copying from client memory inside glTex*Image2D. With GL 4.4 (and a
+/// loader generated for it) the buffers are persistently mapped and reused once a fence says the GPU
+/// is done reading them, otherwise each use orphans the buffer storage and maps it again. Render thread only.
+class PixelBufferRing final {
+  public:
+    static constexpr size_t kNumBuffers = 3;
+    static constexpr size_t kMaxBufferSize = 64 << 20; // larger uploads go straight from client memory
+
+    /// Stage `size` bytes of pixels through the next buffer: `write` fills the mapped memory, then
+    /// `upload` issues texture calls reading from the bound GL_PIXEL_UNPACK_BUFFER (data pointers are
+    /// offsets into it). Returns false, calling neither, when the data can not go through a buffer.
+    template<typename Write, typename Upload>
+    bool upload(size_t size, Write&& write, Upload&& upload) {
+        if (size == 0 || size > kMaxBufferSize)
+            return false;
+        Buffer& buffer = buffers_[next_];
+        next_ = (next_ + 1) % kNumBuffers;
+        uint8_t* data = map(buffer, size);
+        if (!data)
+            return false;
+        write(data);
+        if (!persistent_)
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        upload();
+        if (persistent_)
+            buffer.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+
+    /// Delete the buffers, before the GL context goes away
+    void destroy() {
+        for (Buffer& buffer : buffers_) {
+            wait(buffer);
+            if (buffer.id)
+                glDeleteBuffers(1, &buffer.id);
+            buffer = Buffer{};
+        }
+    }
+
+  private:
+    struct Buffer {
+        GLuint id = 0;
+        size_t capacity = 0;
+        uint8_t* mapped = nullptr; // persistent mapping
+        GLsync fence = nullptr;    // last upload reading from the buffer
+    };
+
+    /// Wait for the GPU to finish reading a buffer
+    static void wait(Buffer& buffer) {
+        if (!buffer.fence)
+            return;
+        glClientWaitSync(buffer.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GLuint64(1e9));
+        glDeleteSync(buffer.fence);
+        buffer.fence = nullptr;
+    }
+
+    /// Bind a buffer and get it mapped for writing at least `size` bytes
+    uint8_t* map(Buffer& buffer, size_t size) {
+#if defined(GL_VERSION_4_4)
+        persistent_ = GLAD_GL_VERSION_4_4;
+#endif
+        if (persistent_)
+            wait(buffer);
+        if (!buffer.id)
+            glGenBuffers(1, &buffer.id);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+        if (buffer.capacity < size) {
+            const size_t capacity = std::min(std::max(size + size / 2, size_t(1) << 20), kMaxBufferSize);
+#if defined(GL_VERSION_4_4)
+            if (persistent_) {
+                // immutable storage can not grow, replace the buffer
+                glDeleteBuffers(1, &buffer.id);
+                glGenBuffers(1, &buffer.id);
+                glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer.id);
+                const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+                glBufferStorage(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(capacity), nullptr, flags);
+                buffer.mapped = static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(capacity), flags));
+            } else
+#endif
+            {
+                glBufferData(GL_PIXEL_UNPACK_BUFFER, GLsizeiptr(capacity), nullptr, GL_STREAM_DRAW);
+            }
+            buffer.capacity = capacity;
+        }
+        uint8_t* data = persistent_ ? buffer.mapped
+            : static_cast<uint8_t*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(size),
+                                                     GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+        if (!data) {
+            WARN("Failed to map a pixel buffer of {} bytes", size);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        }
+        return data;
+    }
+
+    std::array<Buffer, kNumBuffers> buffers_;
+    size_t next_ = 0;
+    bool persistent_ = false;
+};
+
+static PixelBufferRing pixel_buffers;
+static bool pixel_buffer_uploads = true;
+
+/// Set whether texture data is staged through pixel buffers, or passed straight from client memory
+void set_pixel_buffer_uploads(bool enable)
+{
+    pixel_buffer_uploads = enable;
+}
+
+/// Pointer argument of GL texture calls reading at an offset of the bound pixel unpack buffer
+static const void* pixel_buffer_offset(size_t offset)
+{
+    return reinterpret_cast<const void*>(offset);
+}
+
+/// GL state last set for drawing, to skip redundant changes. Reset by begin_render, since uploads and
+/// object creation change bindings outside of drawing (render thread only).
+struct DrawState {
+    GLuint textures[kNumTextureUnits] = {}; // bound on each unit, for its sampler's target
+    std::optional<GLuint> program;
+    std::optional<GLuint> vao;
+    std::optional<glm::mat4> model;
+    std::optional<glm::vec3> position_offset;
+    std::optional<glm::vec3> position_scale;
+    std::optional<bool> octahedral_normals;
+    std::optional<bool> instanced;
+    std::optional<glm::vec4> color;
+    std::optional<std::array<float, 4>> material; // ka, kd, ks, q
+    std::optional<int> texture_layer;
+    const GLVirtualTexture* virtual_texture = nullptr; // whose level uniforms are set
+};
+static DrawState draw_state;
+
+/// Buffer streaming per-instance data of instanced draws, orphaned on each draw
+static UniqueNum<GLuint> instance_buffer;
+
+/// Forget a texture name about to be deleted, the name may be reused by a new texture
+static void forget_texture(GLuint id)
+{
+    for (GLuint& bound : draw_state.textures) {
+        if (bound == id)
+            bound = 0;
+    }
+}
+
+/// Same-sized textures of one format packed as the layers of a GL_TEXTURE_2D_ARRAY,
+/// layers are handed out to textures and taken back as they are released
+struct GLTextureArray final {
+    UniqueNum<GLuint> id;
+    GLenum format = 0;
+    GLenum filter = 0;
+    std::vector<CookedTexture::Level> levels; // size of each mip level of one layer (no data)
+    int capacity = 0;                         // layers allocated
+    int used = 0;                             // layers handed out so far, including the released ones
+    std::vector<int> free_layers;             // released layers, reused first
+
+    ~GLTextureArray() {
+        forget_texture(id);
+        if (id) glDeleteTextures(1, &id.inner);
+    }
+};
+
+GLTexture::~GLTexture()
+{
+    forget_texture(id);
+    if (id) glDeleteTextures(1, &id.inner);
+    if (array) array->free_layers.push_back(layer);
+}
+
+GLTexture& GLTexture::operator=(GLTexture&& o)
+{
+    std::swap(id.inner, o.id.inner);
+    std::swap(array, o.array);
+    std::swap(layer, o.layer);
+    std::swap(virtual_texture, o.virtual_texture);
+    return *this;
+}
+
+/// Texture arrays by format, size, mip levels and filter; each one lives while its textures do
+using TextureArrayKey = std::tuple<GLenum, uint32_t, uint32_t, size_t, GLenum>;
+static std::map<TextureArrayKey, std::vector<std::weak_ptr<GLTextureArray>>> texture_arrays;
+static bool texture_arrays_enabled = true;
+static GLint max_array_layers = 0;
+static constexpr int kArrayLayers = 8; // layers of a new array when arrays can not grow (before GL 4.3)
+
+/// Set whether loaded textures are packed into texture arrays
+void set_texture_arrays(bool enable)
+{
+    texture_arrays_enabled = enable;
+}
+
+static bool is_compressed_format(GLenum format)
+{
+    return format == GL_COMPRESSED_RGB_S3TC_DXT1_EXT || format == GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+}
+
+/// Allocate a new texture with room for `layers` layers of a texture array, left bound
+static GLuint create_array_storage(const GLTextureArray& array, int layers)
+{
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, id);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, array.filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, array.filter);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, GLint(array.levels.size()) - 1);
+    for (size_t i = 0; i < array.levels.size(); i++) {
+        const CookedTexture::Level& level = array.levels[i];
+        if (is_compressed_format(array.format))
+            glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(i), array.format, level.width, level.height, layers, 0,
+                                   GLsizei(level.size * layers), nullptr);
+        else
+            glTexImage3D(GL_TEXTURE_2D_ARRAY, GLint(i), array.format, level.width, level.height, layers, 0,
+                         array.format, GL_UNSIGNED_BYTE, nullptr);
+    }
+    return id;
+}
+
+/// Whether texture arrays can grow, copying their layers to a larger array (needs GL 4.3, and a
+/// loader generated for it)
+static bool can_grow_texture_arrays()
+{
+#if defined(GL_VERSION_4_3)
+    return GLAD_GL_VERSION_4_3;
+#else
+    return false;
+#endif
+}
+
+/// Double the layers of a full texture array, copying the layers in use
+static bool grow_texture_array(GLTextureArray& array)
+{
+#if defined(GL_VERSION_4_3)
+    if (!can_grow_texture_arrays() || array.capacity >= max_array_layers)
+        return false;
+    const int capacity = std::min(array.capacity * 2, int(max_array_layers));
+    const GLuint id = create_array_storage(array, capacity);
+    for (size_t i = 0; i < array.levels.size(); i++) {
+        const CookedTexture::Level& level = array.levels[i];
+        glCopyImageSubData(array.id, GL_TEXTURE_2D_ARRAY, GLint(i), 0, 0, 0,
+                           id, GL_TEXTURE_2D_ARRAY, GLint(i), 0, 0, 0, level.width, level.height, array.used);
+    }
+    forget_texture(array.id);
+    glDeleteTextures(1, &array.id.inner);
+    array.id = id;
+    array.capacity = capacity;
+    return true;
+#else
+    (void)array;
+    return false;
+#endif
+}
+
+/// Take a layer for a cooked texture from a texture array of its kind, creating one when all are full.
+/// The array is left bound.
+static std::pair<Ref<GLTextureArray>, int> alloc_array_layer(const CookedTexture& cooked, GLenum filter)
+{
+    if (!max_array_layers)
+        glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &max_array_layers);
+    const CookedTexture::Level& base = cooked.levels.front();
+    auto& arrays = texture_arrays[{ cooked.gl_format(), base.width, base.height, cooked.levels.size(), filter }];
+    arrays.erase(std::remove_if(arrays.begin(), arrays.end(), [](const auto& array) { return array.expired(); }), arrays.end());
+
+    for (const auto& weak : arrays) {
+        Ref<GLTextureArray> array = weak.lock();
+        if (!array->free_layers.empty()) {
+            const int layer = array->free_layers.back();
+            array->free_layers.pop_back();
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+            return { array, layer };
+        }
+        if (array->used < array->capacity || grow_texture_array(*array)) {
+            glBindTexture(GL_TEXTURE_2D_ARRAY, array->id);
+            return { array, array->used++ };
+        }
+    }
+
+    auto array = std::make_shared<GLTextureArray>();
+    array->format = cooked.gl_format();
+    array->filter = filter;
+    for (const CookedTexture::Level& level : cooked.levels)
+        array->levels.push_back({ level.width, level.height, nullptr, level.size });
+    // arrays able to grow start small, the others leave room for more textures
+    array->capacity = std::min(can_grow_texture_arrays() ? 1 : kArrayLayers, int(max_array_layers));
+    array->id = create_array_storage(*array, array->capacity);
+    arrays.push_back(array);
+    return { array, array->used++ };
+}
+
+/// Upload a cooked texture with all its mip levels into a new GPU texture, packed in a texture array if enabled
+static GLTexture upload_texture(const CookedTexture& cooked, GLenum filter)
+{
+    GLTexture texture{};
+    if (texture_arrays_enabled) {
+        std::tie(texture.array, texture.layer) = alloc_array_layer(cooked, filter);
+    } else {
+        GLuint id;
+        glGenTextures(1, &id);
+        glBindTexture(GL_TEXTURE_2D, id);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(cooked.levels.size()) - 1);
+        texture.id = id;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // rows of RGB levels are not 4-byte aligned
+    const GLenum format = cooked.gl_format();
+    // level data from the bound pixel buffer, where levels are packed one after the other, or from memory
+    const auto upload_levels = [&](bool from_buffer) {
+        size_t offset = 0;
+        for (size_t i = 0; i < cooked.levels.size(); i++) {
+            const CookedTexture::Level& level = cooked.levels[i];
+            const void* data = from_buffer ? pixel_buffer_offset(offset) : level.data;
+            if (texture.array && cooked.is_compressed())
+                glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(i), 0, 0, texture.layer, level.width, level.height, 1,
+                                          format, GLsizei(level.size), data);
+            else if (texture.array)
+                glTexSubImage3D(GL_TEXTURE_2D_ARRAY, GLint(i), 0, 0, texture.layer, level.width, level.height, 1,
+                                format, GL_UNSIGNED_BYTE, data);
+            else if (cooked.is_compressed())
+                glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), format, level.width, level.height, 0, GLsizei(level.size), data);
+            else
+                glTexImage2D(GL_TEXTURE_2D, GLint(i), format, level.width, level.height, 0, format, GL_UNSIGNED_BYTE, data);
+            offset += level.size;
+        }
+    };
+    size_t size = 0;
+    for (const CookedTexture::Level& level : cooked.levels)
+        size += level.size;
+    const bool staged = pixel_buffer_uploads && pixel_buffers.upload(size,
+        [&](uint8_t* data) {
+            for (const CookedTexture::Level& level : cooked.levels) {
+                std::memcpy(data, level.data, level.size);
+                data += level.size;
+            }
+        },
+        [&] { upload_levels(true); });
+    if (!staged)
+        upload_levels(false);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    return texture;
+}
+
+/// Create an uncompressed RGBA texture without mip levels for frequent updates
+GLTextureRef create_stream_texture(int width, int height, GLenum filter)
 {
-    //const std::string filepath = SPACESHIP_ASSETS_PATH + "/"s + inpath;
-    const std::string filepath = inpath.data();
-    auto file = read_file_to_string(filepath);
-    if (!file) { ERROR("Failed to read texture path ({})", filepath); return nullptr; }
-    int width, height, channels;
-    stbi_set_flip_vertically_on_load(true);
-    unsigned char* data = stbi_load_from_memory((const uint8_t*)file->data(), file->length(), &width, &height, &channels, 0);
-    if (!data) { ERROR("Failed to load texture path ({})", filepath); return nullptr; }
-    ASSERT_MSG(channels == 4 || channels == 3, "actual channels: {}", channels);
-    GLenum type = (channels == 4) ? GL_RGBA : GL_RGB;
     GLuint texture;
     glGenTextures(1, &texture);
     glBindTexture(GL_TEXTURE_2D, texture);
@@ -289,151 +880,912 @@ GLTextureRef load_texture(std::string_view inpath, GLenum filter)
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
-    glTexImage2D(GL_TEXTURE_2D, 0, type, width, height, 0, type, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    stbi_image_free(data);
-    return GLTexture{ texture }.to_ref();
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    return GLTexture(texture).to_ref();
+}
+
+/// Replace a region of a stream texture, staged through the pixel buffer ring
+void update_stream_texture(const GLTexture& texture, int x, int y, int width, int height, const void* pixels)
+{
+    glBindTexture(GL_TEXTURE_2D, texture.id);
+    const size_t size = size_t(width) * size_t(height) * 4;
+    const bool staged = pixel_buffer_uploads && pixel_buffers.upload(size,
+        [&](uint8_t* data) { std::memcpy(data, pixels, size); },
+        [&] { glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixel_buffer_offset(0)); });
+    if (!staged)
+        glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, width, height, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+}
+
+/// Pages of a texture holding the resident tiles of the virtual textures of one format
+struct TileCache final {
+    struct Page {
+        GLVirtualTexture* owner = nullptr; // virtual texture whose tile is in the page, or loading into it
+        size_t tile = 0;
+        uint64_t last_used = 0;            // frame the tile was last on screen
+        bool pinned = false;               // coarsest level of a virtual texture, never evicted
+    };
+    UniqueNum<GLuint> id;
+    GLenum format = 0;
+    size_t tile_size = 0; // bytes
+    int pages_x = 0, pages_y = 0;
+    std::vector<Page> pages;
+
+    ~TileCache() {
+        forget_texture(id);
+        if (id) glDeleteTextures(1, &id.inner);
+    }
+};
+
+/// Texture streamed by tiles: a page table tells for each tile of each mip level which page of
+/// the tile cache to sample, that of the tile itself once resident, of its closest resident parent until then
+struct GLVirtualTexture final {
+    Ref<const TiledTexture> tiled; // shared with the loader threads reading tiles
+    Ref<TileCache> cache;
+    UniqueNum<GLuint> page_table;  // RGBA8 page x, page y, level; levels stacked by rows
+    std::vector<glm::vec2> level_sizes;
+    std::vector<GLint> level_rows; // first page table row of each level
+    std::vector<int> pages;        // cache page of each tile, -1 when not in the cache
+    std::vector<bool> resident;    // tile data in its page, otherwise still loading
+    std::vector<uint64_t> requested; // frame each tile was last requested for
+    bool dirty = true;             // page table out of date
+
+    ~GLVirtualTexture();
+};
+
+static std::map<std::pair<GLenum, GLenum>, std::weak_ptr<TileCache>> tile_caches; // by format and filter
+static std::vector<std::weak_ptr<GLVirtualTexture>> virtual_textures;
+static size_t tile_cache_budget = 32 << 20;
+static int virtual_texture_threshold = 0;
+static uint64_t frame_number = 0;                 // frames begun, for evicting the least recently used tiles
+static constexpr size_t kMaxTileLoadsPerFrame = 16;
+static constexpr size_t kMaxVirtualLevels = 16;   // level uniforms in the shader
+
+GLVirtualTexture::~GLVirtualTexture()
+{
+    for (TileCache::Page& page : cache->pages) {
+        if (page.owner == this)
+            page = TileCache::Page{};
+    }
+    forget_texture(page_table);
+    if (page_table) glDeleteTextures(1, &page_table.inner);
+    if (draw_state.virtual_texture == this)
+        draw_state.virtual_texture = nullptr;
+}
+
+/// Set the image size from which textures load as virtual textures, 0 to disable them
+void set_virtual_texture_threshold(int texels)
+{
+    virtual_texture_threshold = texels;
+}
+
+/// Set the GPU memory of each tile cache created afterwards
+void set_virtual_texture_budget(size_t bytes)
+{
+    tile_cache_budget = bytes;
+}
+
+/// Whether an image file is large enough to load as a virtual texture
+static bool is_virtual_image(const FileView& file)
+{
+    int width, height, channels;
+    if (virtual_texture_threshold <= 0
+        || !stbi_info_from_memory((const uint8_t*)file.data(), file.size(), &width, &height, &channels))
+        return false;
+    return std::max(width, height) >= virtual_texture_threshold;
+}
+
+/// Get an image file cut into tiles for streaming: from the texture cache when up to date,
+/// otherwise decoded, cooked and saved to the cache (safe to call from any thread)
+static auto cook_tiled_image_file(const FileView& file, const std::string& filepath) -> std::optional<TiledTexture>
+{
+    const TextureCookOptions options = texture_options;
+    if (options.cache) {
+        if (auto tiled = load_tiled_texture(filepath, options))
+            return tiled;
+    }
+    const auto image = decode_image(file, filepath);
+    if (!image)
+        return std::nullopt;
+    TiledTexture tiled = cook_tiled_texture(image->pixels.get(), image->width, image->height, image->channels, options);
+    if (options.cache)
+        save_tiled_texture(filepath, tiled, options);
+    return tiled;
+}
+
+/// Get the tile cache for virtual textures of a format, creating it within the budget
+static Ref<TileCache> get_tile_cache(const TiledTexture& tiled, GLenum filter)
+{
+    const std::pair<GLenum, GLenum> key{ tiled.gl_format(), filter };
+    if (auto cache = tile_caches[key].lock())
+        return cache;
+
+    GLint max_size = 0;
+    glGetIntegerv(GL_MAX_TEXTURE_SIZE, &max_size);
+    const int max_pages = std::min(255, int(max_size / TiledTexture::kTileSize)); // page coordinates are stored in 8 bits
+    const int side = std::clamp(int(std::sqrt(double(tile_cache_budget / tiled.tile_size))), 1, max_pages);
+    auto cache = std::make_shared<TileCache>();
+    cache->format = tiled.gl_format();
+    cache->tile_size = tiled.tile_size;
+    cache->pages_x = cache->pages_y = side;
+    cache->pages.resize(size_t(side) * side);
+
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    const GLsizei size = side * TiledTexture::kTileSize;
+    if (tiled.is_compressed())
+        glCompressedTexImage2D(GL_TEXTURE_2D, 0, cache->format, size, size, 0, GLsizei(cache->pages.size() * cache->tile_size), nullptr);
+    else
+        glTexImage2D(GL_TEXTURE_2D, 0, cache->format, size, size, 0, cache->format, GL_UNSIGNED_BYTE, nullptr);
+    cache->id = id;
+    DEBUG("Created tile cache of {}x{} pages ({} bytes)", side, side, cache->pages.size() * cache->tile_size);
+    tile_caches[key] = cache;
+    return cache;
+}
+
+/// Take a free page of a tile cache, or the least recently used one not on screen this frame
+/// (its tile goes back to sampling a parent). Returns -1 when every page is in use.
+static int alloc_tile_page(TileCache& cache)
+{
+    int lru = -1;
+    for (size_t i = 0; i < cache.pages.size(); i++) {
+        const TileCache::Page& page = cache.pages[i];
+        if (!page.owner)
+            return int(i);
+        if (page.pinned || page.last_used >= frame_number || !page.owner->resident[page.tile])
+            continue;
+        if (lru < 0 || page.last_used < cache.pages[lru].last_used)
+            lru = int(i);
+    }
+    if (lru >= 0) {
+        TileCache::Page& page = cache.pages[lru];
+        page.owner->pages[page.tile] = -1;
+        page.owner->resident[page.tile] = false;
+        page.owner->dirty = true;
+        page = TileCache::Page{};
+    }
+    return lru;
+}
+
+/// Copy a tile into a page of its tile cache
+static void upload_tile(const TileCache& cache, int page, const uint8_t* data)
+{
+    const GLint x = (page % cache.pages_x) * TiledTexture::kTileSize, y = (page / cache.pages_x) * TiledTexture::kTileSize;
+    const GLsizei size = TiledTexture::kTileSize;
+    const bool compressed = is_compressed_format(cache.format);
+    const auto upload = [&](const void* pixels) {
+        if (compressed)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, 0, x, y, size, size, cache.format, GLsizei(cache.tile_size), pixels);
+        else
+            glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, size, size, cache.format, GL_UNSIGNED_BYTE, pixels);
+    };
+    glBindTexture(GL_TEXTURE_2D, cache.id);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    const bool staged = pixel_buffer_uploads && pixel_buffers.upload(cache.tile_size,
+        [&](uint8_t* dst) { std::memcpy(dst, data, cache.tile_size); },
+        [&] { upload(pixel_buffer_offset(0)); });
+    if (!staged)
+        upload(data);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+/// Point each tile at the page of the finest resident tile, itself or a coarser one, covering the middle
+/// of the tile (the shader looks up the same tile), and upload the table
+static void update_page_table(GLVirtualTexture& vt)
+{
+    constexpr float kContent = TiledTexture::kTileContent;
+    const TiledTexture& tiled = *vt.tiled;
+    std::vector<uint32_t> entries(tiled.num_tiles()); // by tile index, same order as the page table rows
+    for (size_t level = 0; level < tiled.levels.size(); level++) {
+        const TiledTexture::Level& l = tiled.levels[level];
+        for (uint32_t y = 0; y < l.tiles_y; y++) {
+            for (uint32_t x = 0; x < l.tiles_x; x++) {
+                const glm::vec2 uv = (glm::vec2(x, y) + 0.5f) * kContent / vt.level_sizes[level];
+                for (size_t m = level; m < tiled.levels.size(); m++) { // the coarsest level is always resident
+                    const TiledTexture::Level& lm = tiled.levels[m];
+                    const uint32_t mx = std::min(uint32_t(uv.x * lm.width / kContent), lm.tiles_x - 1);
+                    const uint32_t my = std::min(uint32_t(uv.y * lm.height / kContent), lm.tiles_y - 1);
+                    const size_t tile = lm.first_tile + size_t(my) * lm.tiles_x + mx;
+                    if (!vt.resident[tile])
+                        continue;
+                    const int page = vt.pages[tile];
+                    entries[l.first_tile + size_t(y) * l.tiles_x + x] = uint32_t(page % vt.cache->pages_x)
+                        | uint32_t(page / vt.cache->pages_x) << 8 | uint32_t(m) << 16 | 0xFFu << 24;
+                    break;
+                }
+            }
+        }
+    }
+    glBindTexture(GL_TEXTURE_2D, vt.page_table);
+    for (size_t level = 0; level < tiled.levels.size(); level++) {
+        const TiledTexture::Level& l = tiled.levels[level];
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, vt.level_rows[level], l.tiles_x, l.tiles_y, GL_RGBA, GL_UNSIGNED_BYTE,
+                        entries.data() + l.first_tile);
+    }
+    vt.dirty = false;
+}
+
+/// Create a virtual texture from a tiled texture, with its coarsest level resident
+static GLTexture create_virtual_texture(TiledTexture&& tiled, GLenum filter)
+{
+    if (tiled.levels.size() > kMaxVirtualLevels) {
+        ERROR("Texture too large to stream, {} levels of tiles", tiled.levels.size());
+        return GLTexture{};
+    }
+    auto vt = std::make_shared<GLVirtualTexture>();
+    vt->cache = get_tile_cache(tiled, filter);
+    vt->tiled = std::make_shared<const TiledTexture>(std::move(tiled));
+    const TiledTexture& t = *vt->tiled;
+    vt->pages.assign(t.num_tiles(), -1);
+    vt->resident.assign(t.num_tiles(), false);
+    vt->requested.assign(t.num_tiles(), 0);
+    GLint rows = 0;
+    for (const TiledTexture::Level& level : t.levels) {
+        vt->level_sizes.emplace_back(level.width, level.height);
+        vt->level_rows.push_back(rows);
+        rows += level.tiles_y;
+    }
+
+    const size_t coarsest = t.num_tiles() - 1; // the last level is a single tile
+    const int page = alloc_tile_page(*vt->cache);
+    if (page < 0) {
+        ERROR("Tile cache full of pinned tiles, raise the virtual texture budget");
+        return GLTexture{};
+    }
+    vt->cache->pages[page] = { vt.get(), coarsest, frame_number, true };
+    vt->pages[coarsest] = page;
+    vt->resident[coarsest] = true;
+    upload_tile(*vt->cache, page, t.tile(coarsest));
+
+    GLuint id;
+    glGenTextures(1, &id);
+    glBindTexture(GL_TEXTURE_2D, id);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, t.levels[0].tiles_x, rows, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    vt->page_table = id;
+    update_page_table(*vt);
+
+    virtual_textures.push_back(vt);
+    GLTexture texture{};
+    texture.virtual_texture = std::move(vt);
+    return texture;
+}
+
+/// Mark the tiles of a virtual texture covering a texture area as needed at a level this frame
+static void request_tiles(GLVirtualTexture& vt, size_t level, glm::vec2 uv_min, glm::vec2 uv_max)
+{
+    constexpr float kContent = TiledTexture::kTileContent;
+    const TiledTexture::Level& l = vt.tiled->levels[level];
+    const auto tile_x = [&](float u) { return std::min(uint32_t(std::clamp(u, 0.f, 1.f) * l.width / kContent), l.tiles_x - 1); };
+    const auto tile_y = [&](float v) { return std::min(uint32_t(std::clamp(v, 0.f, 1.f) * l.height / kContent), l.tiles_y - 1); };
+    for (uint32_t y = tile_y(uv_min.y); y <= tile_y(uv_max.y); y++)
+        for (uint32_t x = tile_x(uv_min.x); x <= tile_x(uv_max.x); x++)
+            vt.requested[l.first_tile + size_t(y) * l.tiles_x + x] = frame_number;
+}
+
+/// Load the tiles requested this frame that are not in the cache yet, coarsest levels first,
+/// on the loader threads; they show up in a later frame
+static void stream_virtual_textures()
+{
+    virtual_textures.erase(std::remove_if(virtual_textures.begin(), virtual_textures.end(),
+                                          [](const auto& vt) { return vt.expired(); }), virtual_textures.end());
+    // keep every tile on screen from being evicted by the loads below
+    for (const auto& weak : virtual_textures) {
+        Ref<GLVirtualTexture> vt = weak.lock();
+        for (size_t tile = 0; tile < vt->requested.size(); tile++) {
+            if (vt->requested[tile] == frame_number && vt->pages[tile] >= 0)
+                vt->cache->pages[vt->pages[tile]].last_used = frame_number;
+        }
+    }
+    size_t loads = 0;
+    for (const auto& weak : virtual_textures) {
+        Ref<GLVirtualTexture> vt = weak.lock();
+        TileCache& cache = *vt->cache;
+        for (size_t tile = vt->requested.size(); tile-- > 0 && loads < kMaxTileLoadsPerFrame;) {
+            if (vt->requested[tile] != frame_number || vt->pages[tile] >= 0)
+                continue;
+            const int page = alloc_tile_page(cache);
+            if (page < 0)
+                break; // every page is on screen, over budget
+            cache.pages[page] = { vt.get(), tile, frame_number, false };
+            vt->pages[tile] = page;
+            loads++;
+            loader_pool().submit([vt = std::weak_ptr<GLVirtualTexture>(vt), tiled = vt->tiled, tile, page] {
+                // reading the tile from the mapped file is where the disk is hit
+                auto data = std::make_shared<std::vector<uint8_t>>(tiled->tile(tile), tiled->tile(tile) + tiled->tile_size);
+                post_upload([vt, tile, page, data] {
+                    Ref<GLVirtualTexture> live = vt.lock();
+                    if (!live || live->pages[tile] != page) // released, or evicted meanwhile
+                        return true;
+                    upload_tile(*live->cache, page, data->data());
+                    live->resident[tile] = true;
+                    live->dirty = true;
+                    return true;
+                });
+            });
+        }
+    }
+}
+
+/// Upload the page tables changed by tiles loaded or evicted since the last frame
+static void update_page_tables()
+{
+    for (const auto& weak : virtual_textures) {
+        if (Ref<GLVirtualTexture> vt = weak.lock(); vt && vt->dirty)
+            update_page_table(*vt);
+    }
+}
+
+/// Image file ready for upload: its whole mip chain, or its tiles when streamed as a virtual texture
+using TextureData = std::variant<CookedTexture, TiledTexture>;
+
+/// Cook an image file for upload, as a virtual texture if large enough (safe to call from any thread)
+static auto prepare_image_file(const FileView& file, const std::string& filepath) -> std::optional<TextureData>
+{
+    if (is_virtual_image(file)) {
+        if (auto tiled = cook_tiled_image_file(file, filepath))
+            return TextureData(std::move(*tiled));
+        return std::nullopt;
+    }
+    if (auto cooked = cook_image_file(file, filepath))
+        return TextureData(std::move(*cooked));
+    return std::nullopt;
+}
+
+/// Upload a prepared image file into a new GPU texture
+static GLTexture upload_texture_data(TextureData& data, GLenum filter)
+{
+    if (auto* tiled = std::get_if<TiledTexture>(&data))
+        return create_virtual_texture(std::move(*tiled), filter);
+    return upload_texture(std::get<CookedTexture>(data), filter);
+}
+
+/// Absolute path without symbolic links or dot components, the path itself if that fails
+static std::string canonical_path(const std::string& path)
+{
+    std::error_code ec;
+    const auto canonical = std::filesystem::weakly_canonical(path, ec);
+    return ec ? path : canonical.string();
+}
+
+static void watch_file(const std::string& path);
+
+/// Resident textures by canonical file path and by file content, so each image is decoded and
+/// uploaded once even when referenced through different paths or copied to other directories.
+/// References are weak: a texture is freed once no material/object uses it anymore.
+using TexturePathKey = std::pair<std::string, GLenum>;             // canonical path, filter
+using TextureContentKey = std::tuple<size_t, size_t, GLenum>;      // content hash, size, filter
+static std::map<TexturePathKey, std::weak_ptr<GLTexture>> textures_by_path;
+static std::map<TextureContentKey, std::weak_ptr<GLTexture>> textures_by_content;
+static std::mutex texture_cache_mutex;
+
+/// Get a resident texture from a cache map, dropping the entry if expired (lock must be held)
+template<typename Map>
+static GLTextureRef find_texture(Map& map, const typename Map::key_type& key)
+{
+    auto it = map.find(key);
+    if (it == map.end())
+        return nullptr;
+    if (auto texture = it->second.lock())
+        return texture;
+    map.erase(it);
+    return nullptr;
+}
+
+/// Remove every cache entry of a texture, so its file is read again when next loaded
+static void forget_cached_texture(const GLTextureRef& texture)
+{
+    std::lock_guard lock(texture_cache_mutex);
+    for (auto it = textures_by_path.begin(); it != textures_by_path.end(); )
+        it = (it->second.lock() == texture) ? textures_by_path.erase(it) : std::next(it);
+    for (auto it = textures_by_content.begin(); it != textures_by_content.end(); )
+        it = (it->second.lock() == texture) ? textures_by_content.erase(it) : std::next(it);
+}
+
+/// Get the resident texture for an image file, otherwise create it with `make` and cache it
+/// (the file is only read when not found by its path)
+static GLTextureRef load_texture_cached(const std::string& filepath, GLenum filter,
+                                        const std::function<GLTextureRef(Ref<FileView>)>& make)
+{
+    const TexturePathKey path_key{ canonical_path(filepath), filter };
+    watch_file(path_key.first);
+    {
+        std::lock_guard lock(texture_cache_mutex);
+        if (auto texture = find_texture(textures_by_path, path_key))
+            return texture;
+    }
+
+    auto file = FileView::open(filepath);
+    if (!file) { ERROR("Failed to read texture path ({})", filepath); return nullptr; }
+    const TextureContentKey content_key{ std::hash<std::string_view>{}(file->str()), file->size(), filter };
+    {
+        std::lock_guard lock(texture_cache_mutex);
+        if (auto texture = find_texture(textures_by_content, content_key)) {
+            DEBUG("Texture {} has the same content of a loaded texture", filepath);
+            textures_by_path[path_key] = texture;
+            return texture;
+        }
+    }
+
+    GLTextureRef texture = make(std::make_shared<FileView>(std::move(*file)));
+    if (!texture)
+        return nullptr;
+
+    std::lock_guard lock(texture_cache_mutex);
+    // another thread may have loaded the same image meanwhile, then share the first one
+    if (auto loaded = find_texture(textures_by_content, content_key))
+        texture = std::move(loaded);
+    textures_by_path[path_key] = texture;
+    textures_by_content[content_key] = texture;
+    return texture;
+}
+
+/// Load a texture file from give path into GPU memory
+GLTextureRef load_texture(std::string_view inpath, GLenum filter)
+{
+    //const std::string filepath = SPACESHIP_ASSETS_PATH + "/"s + inpath;
+    const std::string filepath(inpath);
+    return load_texture_cached(filepath, filter, [&](Ref<FileView> file) -> GLTextureRef {
+        auto data = prepare_image_file(*file, filepath);
+        if (!data)
+            return nullptr;
+        return upload_texture_data(*data, filter).to_ref();
+    });
+}
+
+/// Load a texture file in the background, the returned texture is empty until uploaded
+GLTextureRef load_texture_async(std::string_view inpath, GLenum filter)
+{
+    const std::string filepath(inpath);
+    return load_texture_cached(filepath, filter, [&](Ref<FileView> file) {
+        auto texture = GLTexture{}.to_ref();
+        loader_pool().submit([texture, file = std::move(file), filepath, filter]() mutable {
+            auto data = prepare_image_file(*file, filepath);
+            file.reset();
+            // the texture reference moves along so it is only ever released on the render thread
+            if (!data) {
+                // the texture stays empty, drop it from the caches so a later load tries the file again
+                post_upload([texture = std::move(texture)] {
+                    forget_cached_texture(texture);
+                    return true;
+                });
+                return;
+            }
+            post_upload([texture = std::move(texture), data = std::make_shared<TextureData>(std::move(*data)), filter] {
+                *texture = upload_texture_data(*data, filter);
+                return true;
+            });
+        });
+        return texture;
+    });
+}
+
+/// Load several texture files: decoded in parallel by the loader threads, then uploaded from the
+/// calling thread in order as each one is ready, overlapping with the decoding of the next ones
+std::vector<GLTextureRef> load_textures(const std::vector<std::string>& paths, GLenum filter)
+{
+    struct Pending {
+        GLTextureRef texture;
+        std::future<std::optional<TextureData>> data;
+    };
+    std::vector<GLTextureRef> textures(paths.size());
+    std::vector<Pending> pending;
+    for (size_t i = 0; i < paths.size(); i++) {
+        const std::string& filepath = paths[i];
+        textures[i] = load_texture_cached(filepath, filter, [&](Ref<FileView> file) {
+            auto promise = std::make_shared<std::promise<std::optional<TextureData>>>();
+            pending.push_back({ GLTexture{}.to_ref(), promise->get_future() });
+            loader_pool().submit([promise, file = std::move(file), filepath] {
+                promise->set_value(prepare_image_file(*file, filepath));
+            });
+            return pending.back().texture;
+        });
+    }
+
+    for (Pending& p : pending) {
+        auto data = p.data.get();
+        if (data) {
+            *p.texture = upload_texture_data(*data, filter);
+            continue;
+        }
+        // failed like load_texture(), also where the batch named the same image again
+        std::replace(textures.begin(), textures.end(), p.texture, GLTextureRef());
+    }
+    return textures;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// MESH/MODEL
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void track_model(const ModelRef& model, const ModelLoadOptions& options);
+
+/// Load the diffuse textures of every model material, all at once or in the background
+static void load_material_textures(Model& model, bool async)
+{
+    std::vector<MaterialRef> textured;
+    std::vector<std::string> paths;
+    for (const MaterialRef& material : model.materials) {
+        if (material->diffuse_map.empty())
+            continue;
+        if (async) {
+            material->diffuse_tex = load_texture_async(material->diffuse_map, GL_LINEAR);
+        } else {
+            textured.push_back(material);
+            paths.push_back(material->diffuse_map);
+        }
+    }
+    if (paths.empty())
+        return;
+    std::vector<GLTextureRef> textures = load_textures(paths, GL_LINEAR);
+    for (size_t i = 0; i < textured.size(); i++)
+        textured[i]->diffuse_tex = std::move(textures[i]);
+}
+
+/// Load an OBJ model meshes and materials from file
+ModelRef load_model(std::string_view filepath, const ModelLoadOptions& options)
+{
+    ModelRef model = parse_model(filepath, options);
+    if (model) {
+        load_material_textures(*model, false);
+        track_model(model, options);
+    }
+    return model;
+}
+
+/// Load an OBJ model in the background, material textures follow with load_texture_async()
+std::shared_future<ModelRef> load_model_async(std::string_view filepath, const ModelLoadOptions& options)
+{
+    auto promise = std::make_shared<std::promise<ModelRef>>();
+    std::shared_future<ModelRef> future = promise->get_future().share();
+    loader_pool().submit([promise, filepath = std::string(filepath), options]() mutable {
+        ModelRef model = parse_model(filepath, options);
+        if (model) {
+            load_material_textures(*model, true);
+            track_model(model, options);
+        }
+        // the model holds texture references, fulfil the promise on the render thread so that when
+        // nobody waits for it anymore the model and its textures are released there too
+        post_upload([promise = std::move(promise), model = std::move(model)]() mutable {
+            promise->set_value(std::move(model));
+            return true;
+        });
+    });
+    return future;
+}
+
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// HOT RELOAD
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+static GLObject create_mesh_globject(const Mesh& mesh, GLenum usage);
+
+/// Loaded model and the GPU objects created from its mesh, refreshed when its files change
+struct TrackedModel {
+    std::weak_ptr<Model> model;
+    ModelLoadOptions options;
+    std::vector<std::string> files; // canonical paths of the model sources
+    std::vector<std::pair<std::weak_ptr<GLObject>, GLenum>> globjects; // with their buffer usage
+};
+static std::vector<TrackedModel> tracked_models;
+static std::mutex tracked_models_mutex;
+
+static bool hot_reload_enabled = false;
+static FnReloadHandler reload_callback = nullptr;
+static void* reload_cookie = nullptr;
+
+/// Changed files waiting for writes to settle before being reloaded
+struct PendingChange {
+    double detected; // first change
+    double last;     // latest change
+};
+static std::map<std::string, PendingChange> pending_changes;
+static constexpr double kReloadSettleTime = 0.1; // seconds without new changes
+
+#if defined(__linux__)
+static int inotify_fd = -1;
+static std::map<int, std::string> watched_dirs; // inotify watch descriptor -> canonical directory
+static std::mutex watched_dirs_mutex;
+#endif
+
+/// Watch the directory of a file for changes, if hot reload is enabled (editors and exporters
+/// often replace files by renaming a new one over them, which a watch on the file itself would miss)
+static void watch_file(const std::string& path)
+{
+#if defined(__linux__)
+    std::lock_guard lock(watched_dirs_mutex);
+    if (inotify_fd < 0)
+        return;
+    const std::string dir = std::filesystem::path(path).parent_path().string();
+    const int wd = inotify_add_watch(inotify_fd, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+    if (wd < 0) {
+        WARN("Failed to watch directory {}: {}", dir, std::strerror(errno));
+        return;
+    }
+    watched_dirs[wd] = dir;
+#else
+    (void)path;
+#endif
+}
+
+/// Canonical paths of the files a model is built from, watching them for changes
+static auto watch_model_files(const Model& model) -> std::vector<std::string>
+{
+    std::vector<std::string> files;
+    for (const std::string& source : model.sources) {
+        files.push_back(canonical_path(source));
+        watch_file(files.back());
+    }
+    return files;
+}
+
+/// Keep track of a loaded model, to reload it when its files change
+static void track_model(const ModelRef& model, const ModelLoadOptions& options)
+{
+    TrackedModel tracked{ model, options, watch_model_files(*model), {} };
+    std::lock_guard lock(tracked_models_mutex);
+    tracked_models.erase(std::remove_if(tracked_models.begin(), tracked_models.end(),
+                                        [](const TrackedModel& t) { return t.model.expired(); }),
+                         tracked_models.end());
+    tracked_models.push_back(std::move(tracked));
+}
+
+/// Keep track of a GPU object created from a tracked model mesh, to update it when the model is reloaded
+static void track_globject(const Mesh& mesh, const GLObjectRef& glo, GLenum usage)
+{
+    std::lock_guard lock(tracked_models_mutex);
+    for (TrackedModel& tracked : tracked_models) {
+        ModelRef model = tracked.model.lock();
+        if (model && &model->mesh == &mesh) {
+            tracked.globjects.emplace_back(glo, usage);
+            return;
+        }
+    }
 }
 
-/// 1x1 pixel default white texture
-static GLTextureRef white_texture = nullptr;
+/// Report a reload done (on the render thread)
+static void report_reload(const std::string& path, double detected)
+{
+    const double latency = get_time() - detected;
+    DEBUG("Reloaded {} in {:.1f} ms", path, latency * 1e3);
+    if (reload_callback)
+        reload_callback(path, latency, reload_cookie);
+}
 
-/// Load a default 1x1 white texture for drawing color-filled only objects
-void load_white_texture()
+/// Parse a changed OBJ file again and replace the model and its GPU objects
+static void reload_model(const TrackedModel& tracked, const std::string& path, double detected)
 {
-    GLuint texture;
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-    unsigned char data[] = { 255, 255, 255, 255 };
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    white_texture = GLTexture{ texture }.to_ref();
+    ModelRef model = tracked.model.lock();
+    if (!model)
+        return;
+    loader_pool().submit([model = std::weak_ptr<Model>(model), filepath = model->sources.front(), options = tracked.options,
+                          globjects = tracked.globjects, path, detected] {
+        ModelRef reloaded = parse_model(filepath, options);
+        if (!reloaded)
+            return; // keep the current one, the file may be saved again
+        load_material_textures(*reloaded, true);
+        post_upload([model, reloaded = std::move(reloaded), globjects, path, detected] {
+            ModelRef current = model.lock();
+            if (!current)
+                return true;
+            *current = std::move(*reloaded);
+            for (const auto& [glo, usage] : globjects) {
+                if (GLObjectRef live = glo.lock())
+                    *live = create_mesh_globject(current->mesh, usage);
+            }
+            {
+                // the model may have changed MTL libraries
+                std::lock_guard lock(tracked_models_mutex);
+                for (TrackedModel& tracked : tracked_models) {
+                    if (tracked.model.lock() == current)
+                        tracked.files = watch_model_files(*current);
+                }
+            }
+            report_reload(path, detected);
+            return true;
+        });
+    });
 }
 
+/// Parse a changed MTL file again and update the same named materials of the models using it
+static void reload_materials(std::vector<std::weak_ptr<Model>> models, const std::string& path, double detected)
+{
+    loader_pool().submit([models = std::move(models), path, detected] {
+        auto materials = load_mtl(path);
+        if (!materials)
+            return;
+        for (const MaterialRef& material : *materials) {
+            if (!material->diffuse_map.empty())
+                material->diffuse_tex = load_texture_async(material->diffuse_map, GL_LINEAR);
+        }
+        post_upload([models, materials = std::move(*materials), path, detected] {
+            for (const auto& weak : models) {
+                ModelRef model = weak.lock();
+                if (!model)
+                    continue;
+                for (const MaterialRef& current : model->materials) {
+                    auto it = std::find_if(materials.begin(), materials.end(), [&](auto& m) { return m->name == current->name; });
+                    if (it != materials.end())
+                        *current = **it;
+                }
+            }
+            report_reload(path, detected);
+            return true;
+        });
+    });
+}
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// MESH/MODEL
-///////////////////////////////////////////////////////////////////////////////////////////////////
+/// Decode a changed image file again and replace the contents of the textures loaded from it
+static void reload_texture(const GLTextureRef& texture, GLenum filter, const std::string& path, double detected)
+{
+    loader_pool().submit([texture = std::weak_ptr<GLTexture>(texture), filter, path, detected] {
+        auto file = FileView::open(path);
+        if (!file)
+            return;
+        auto data = prepare_image_file(*file, path);
+        if (!data)
+            return;
+        const TextureContentKey content_key{ std::hash<std::string_view>{}(file->str()), file->size(), filter };
+        post_upload([texture, filter, content_key, data = std::make_shared<TextureData>(std::move(*data)), path, detected] {
+            GLTextureRef live = texture.lock();
+            if (!live)
+                return true;
+            *live = upload_texture_data(*data, filter);
+            {
+                // the texture is now found by its new content only
+                std::lock_guard lock(texture_cache_mutex);
+                for (auto it = textures_by_content.begin(); it != textures_by_content.end(); ) {
+                    if (it->second.lock() == live)
+                        it = textures_by_content.erase(it);
+                    else
+                        ++it;
+                }
+                textures_by_content[content_key] = live;
+            }
+            report_reload(path, detected);
+            return true;
+        });
+    });
+}
 
-/// Load first Material from a MTL file
-static auto load_mtl(const std::string& filename) -> std::optional<Material>
+/// Check if a file is used by any loaded model or texture
+static bool is_tracked_file(const std::string& path)
 {
-    auto file = std::ifstream(filename);
-    if (!file.good()) {
-        ERROR("Error opening MTL file '{}', error: {}", filename.data(), std::strerror(errno));
-        return std::nullopt;
+    {
+        std::lock_guard lock(tracked_models_mutex);
+        for (const TrackedModel& tracked : tracked_models) {
+            if (!tracked.model.expired() && std::find(tracked.files.begin(), tracked.files.end(), path) != tracked.files.end())
+                return true;
+        }
     }
+    std::lock_guard lock(texture_cache_mutex);
+    auto it = textures_by_path.lower_bound({ path, 0 });
+    return it != textures_by_path.end() && it->first.first == path;
+}
 
-    Material material{};
-    char buf[BUFSIZ];
-    while (file.getline(buf, sizeof(buf))) {
-        std::stringstream ss(buf);
-        std::string code;
-        ss >> code;
-        if (code == "map_Kd") {
-            std::string texture;
-            ss >> texture;
-            auto tex_path = std::filesystem::path(filename).remove_filename().append(texture).string();
-            material.diffuse_tex = load_texture(tex_path, GL_LINEAR);
-        }
-        else if (code == "Ns") {
-            float ns;
-            ss >> ns;
-            material.q = ns;
-        }
-        else if (code == "Ka") {
-            float ka, dummy;
-            ss >> ka >> dummy >> dummy;
-            material.ka = ka;
-        }
-        else if (code == "Kd") {
-            float kd, dummy;
-            ss >> kd >> dummy >> dummy;
-            material.kd = kd;
-        }
-        else if (code == "Ks") {
-            float ks, dummy;
-            ss >> ks >> dummy >> dummy;
-            material.ks = ks;
+/// Reload whatever was loaded from a changed file, other assets are left untouched
+static void reload_file(const std::string& path, double detected)
+{
+    {
+        std::lock_guard lock(tracked_models_mutex);
+        std::vector<std::weak_ptr<Model>> mtl_users;
+        for (const TrackedModel& tracked : tracked_models) {
+            const auto it = std::find(tracked.files.begin(), tracked.files.end(), path);
+            if (it == tracked.files.begin())
+                reload_model(tracked, path, detected);
+            else if (it != tracked.files.end())
+                mtl_users.push_back(tracked.model);
         }
+        if (!mtl_users.empty())
+            reload_materials(std::move(mtl_users), path, detected);
     }
 
-    return material;
+    std::lock_guard lock(texture_cache_mutex);
+    for (auto it = textures_by_path.lower_bound({ path, 0 }); it != textures_by_path.end() && it->first.first == path; ++it) {
+        if (GLTextureRef texture = it->second.lock())
+            reload_texture(texture, it->first.second, path, detected);
+    }
 }
 
-/// Load an OBJ model meshes and materials from file
-ModelRef load_model(std::string_view filepath)
+/// Collect file change events and reload the files whose changes have settled (on the render thread)
+static void process_file_changes()
 {
-    auto file = std::ifstream(filepath.data());
-    if (!file.good()) {
-        ERROR("Failed to open OBJ file {}, error: {}", filepath.data(), std::strerror(errno));
-        return nullptr;
-    }
-
-    Model model;
-    Mesh* curr_mesh = &model.meshes[0];
-    std::vector<glm::vec3> positions;
-    std::vector<glm::vec3> normals;
-    std::vector<glm::vec2> texcoords;
-
-    char buf[BUFSIZ];
-    while (file.getline(buf, sizeof(buf))) {
-        std::stringstream ss(buf);
-        std::string code;
-        ss >> code;
-        if (code == "v") {
-            glm::vec3 v;
-            ss >> v.x; ss >> v.y; ss >> v.z;
-            positions.push_back(v);
-        }
-        else if (code == "vn") {
-            glm::vec3 vn;
-            ss >> vn.x >> vn.y >> vn.z;
-            normals.push_back(vn);
+    const double now = get_time();
+#if defined(__linux__)
+    if (inotify_fd < 0)
+        return;
+    alignas(struct inotify_event) char buffer[4096];
+    ssize_t length;
+    while ((length = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+        for (const char* ptr = buffer; ptr < buffer + length; ) {
+            const auto* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            if (event->len == 0)
+                continue;
+            std::string path;
+            {
+                std::lock_guard lock(watched_dirs_mutex);
+                auto dir = watched_dirs.find(event->wd);
+                if (dir == watched_dirs.end())
+                    continue;
+                path = (std::filesystem::path(dir->second) / event->name).string();
+            }
+            if (!is_tracked_file(path))
+                continue;
+            auto [it, inserted] = pending_changes.try_emplace(path, PendingChange{ now, now });
+            it->second.last = now;
         }
-        else if (code == "vt") {
-            glm::vec2 vt;
-            ss >> vt.x; ss >> vt.y;
-            texcoords.push_back(vt);
+    }
+#endif
+    for (auto it = pending_changes.begin(); it != pending_changes.end(); ) {
+        if (now - it->second.last < kReloadSettleTime) {
+            ++it;
+            continue;
         }
-        else if (code == "f") {
-            glm::u32vec3 fv; // positions
-            glm::u32vec3 fvt; // textcoord
-            glm::u32vec3 fvn; // normal
-            ss >> fv[0]; ss.get() /*slash*/; ss >> fvt[0]; ss.get() /*slash*/; ss >> fvn[0];
-            ss >> fv[1]; ss.get() /*slash*/; ss >> fvt[1]; ss.get() /*slash*/; ss >> fvn[1];
-            ss >> fv[2]; ss.get() /*slash*/; ss >> fvt[2]; ss.get() /*slash*/; ss >> fvn[2];
-            fv -= glm::u32vec3(1); /* index is offset by 1 */
-            fvt -= glm::u32vec3(1); /* index is offset by 1 */
-            fvn -= glm::u32vec3(1); /* index is offset by 1 */
-            for (int i : {0, 1, 2}) {
-                curr_mesh->vertices.push_back(positions[fv[i]].x);
-                curr_mesh->vertices.push_back(positions[fv[i]].y);
-                curr_mesh->vertices.push_back(positions[fv[i]].z);
-                curr_mesh->vertices.push_back(texcoords[fvt[i]].s);
-                curr_mesh->vertices.push_back(texcoords[fvt[i]].t);
-                curr_mesh->vertices.push_back(normals[fvn[i]].x);
-                curr_mesh->vertices.push_back(normals[fvn[i]].y);
-                curr_mesh->vertices.push_back(normals[fvn[i]].z);
+        DEBUG("File {} changed, reloading", it->first);
+        reload_file(it->first, it->second.detected);
+        it = pending_changes.erase(it);
+    }
+}
+
+/// Watch the files of loaded assets and reload them when changed on disk
+void set_hot_reload(bool enable)
+{
+    if (enable == hot_reload_enabled)
+        return;
+#if defined(__linux__)
+    if (enable) {
+        {
+            std::lock_guard lock(watched_dirs_mutex);
+            inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+            if (inotify_fd < 0) {
+                ERROR("Failed to start watching files: {}", std::strerror(errno));
+                return;
             }
         }
-        else if (code == "mtllib") {
-            std::string mtllib_str;
-            ss >> mtllib_str;
-            auto mtlpath = std::filesystem::path(filepath).remove_filename().append(mtllib_str).string();
-            auto mtl = load_mtl(mtlpath);
-            if (!mtl) {
-                ERROR("Failed to read MTL file: {}", mtlpath);
-                return nullptr;
-            }
-            curr_mesh->material = mtl->to_ref();
+        // watch the assets loaded so far
+        std::vector<std::string> files;
+        {
+            std::lock_guard lock(tracked_models_mutex);
+            for (const TrackedModel& tracked : tracked_models)
+                files.insert(files.end(), tracked.files.begin(), tracked.files.end());
         }
+        {
+            std::lock_guard lock(texture_cache_mutex);
+            for (const auto& [key, texture] : textures_by_path)
+                files.push_back(key.first);
+        }
+        for (const std::string& file : files)
+            watch_file(file);
+    } else {
+        std::lock_guard lock(watched_dirs_mutex);
+        close(inotify_fd);
+        inotify_fd = -1;
+        watched_dirs.clear();
+        pending_changes.clear();
     }
+    hot_reload_enabled = enable;
+#else
+    if (enable)
+        WARN("Hot reload is only supported on Linux");
+#endif
+}
 
-    return std::make_shared<Model>(std::move(model));
+/// Set handler notified of every hot reload
+void set_reload_callback(FnReloadHandler callback, void* cookie)
+{
+    reload_callback = callback;
+    reload_cookie = cookie;
 }
 
 
@@ -480,6 +1832,19 @@ static void load_opengl()
     }
 }
 
+/// Check whether the current OpenGL context supports an extension
+static bool has_gl_extension(std::string_view name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, GLuint(i)));
+        if (extension && name == extension)
+            return true;
+    }
+    return false;
+}
+
 /// Initialize the Window with OpenGL context and core library globals
 auto init_window(int width, int height, const char* title) -> Window
 {
@@ -514,10 +1879,13 @@ auto init_window(int width, int height, const char* title) -> Window
 
     // OpenGL
     load_opengl();
+    if (!has_gl_extension("GL_EXT_texture_compression_s3tc")) {
+        WARN("S3TC texture compression not supported, textures are uploaded uncompressed");
+        texture_options.compress = false;
+    }
 
     // Default resources
     load_generic_shader();
-    load_white_texture();
 
     // Init main camera
     camera = new Camera3D();
@@ -528,8 +1896,14 @@ auto init_window(int width, int height, const char* title) -> Window
 /// Finalize the core and close the window
 void close_window()
 {
+    set_hot_reload(false);
+    {
+        std::lock_guard lock(upload_mutex);
+        upload_queue.clear();
+    }
     generic_shader.reset();
-    white_texture.reset();
+    pixel_buffers.destroy();
+    if (instance_buffer) glDeleteBuffers(1, &instance_buffer.inner);
     delete camera;
 
     glfwTerminate();
@@ -657,9 +2031,23 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 glm::vec3 light_pos = {-2.0, 10.0, 2.0};
 glm::vec3 light_color = {1.0, 1.0, 1.0};
 
+/// Screen pixels covered by one world unit one unit away from the camera, for picking LODs
+static float pixels_per_unit_at_unit_distance = 1.f;
+
+/// Left, right, bottom and top planes of the view frustum in world space, pointing inwards
+static std::array<glm::vec4, 4> frustum_planes;
+
+/// Rendering counters of the current frame
+static RenderStats render_stats;
+
 /// Prepare to render
 void begin_render(Color color)
 {
+    process_file_changes();
+    process_uploads();
+    update_page_tables();
+    frame_number++;
+
     glEnable(GL_BLEND);
     glEnable(GL_DEPTH_TEST);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -682,7 +2070,16 @@ void begin_render(Color color)
     int width, height;
     glfwGetWindowSize(window, &width, &height);
     float aspect = (float)width / (float)height;
-    glm::mat4 projection = glm::perspective(glm::radians(45.0f), aspect, +1.0f, -1.0f);
+    constexpr float kFieldOfView = glm::radians(45.0f);
+    glm::mat4 projection = glm::perspective(kFieldOfView, aspect, +1.0f, -1.0f);
+    pixels_per_unit_at_unit_distance = height / (2.f * std::tan(kFieldOfView / 2.f));
+    const glm::mat4 clip = glm::transpose(projection * view); // rows as columns
+    for (int i = 0; i < 4; i++) {
+        const glm::vec4 plane = clip[3] + (i % 2 ? -1.f : 1.f) * clip[i / 2];
+        frustum_planes[i] = plane / glm::length(glm::vec3(plane));
+    }
+    render_stats = {};
+    draw_state = {};
     glUniformMatrix4fv(shader.unif_loc(GLUnif::PROJECTION), 1, GL_FALSE, glm::value_ptr(projection));
 
     // Ambient Light
@@ -693,49 +2090,390 @@ void begin_render(Color color)
 /// End rendering procedure
 void end_render()
 {
+    stream_virtual_textures();
     glfwSwapBuffers(window);
 }
 
+/// Get the rendering counters of the current (or last ended) frame
+const RenderStats& get_render_stats()
+{
+    return render_stats;
+}
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // DRAWING
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Draw a generic object (textured or colored)
-void draw_object(const Object& obj) {
-    if (!obj.m_glo)
+/// Values of the shader texture layer for textures not packed in arrays
+static constexpr int kLayerTexture2D = -1;  // sample uTexture0
+static constexpr int kLayerUntextured = -2; // plain white
+static constexpr int kLayerVirtual = -3;    // sample the tile cache through uPageTable
+
+/// Record a value about to be set in the GL state, false when it is already set
+template<typename T>
+static bool update_state(std::optional<T>& current, const T& value)
+{
+    if (current && *current == value)
+        return false;
+    current = value;
+    render_stats.state_changes++;
+    return true;
+}
+
+/// Bind a texture on a unit for drawing, unless already bound
+static void bind_texture(GLuint unit, GLenum target, GLuint id)
+{
+    if (draw_state.textures[unit] == id)
+        return;
+    glActiveTexture(GL_TEXTURE0 + unit);
+    glBindTexture(target, id);
+    glActiveTexture(GL_TEXTURE0);
+    draw_state.textures[unit] = id;
+    render_stats.texture_binds++;
+    render_stats.state_changes++;
+}
+
+static void set_texture_layer(const GLShader& shader, int layer)
+{
+    if (update_state(draw_state.texture_layer, layer))
+        glUniform1i(shader.unif_loc(GLUnif::TEXTURE_LAYER), layer);
+}
+
+/// Texture of a material ready to sample, if any
+static const GLTexture* material_texture(const Material& material)
+{
+    return (material.diffuse_tex && material.diffuse_tex->is_loaded()) ? material.diffuse_tex.get() : nullptr;
+}
+
+/// Set material uniforms and bind its texture, skipping what is already set
+static void set_material(const GLShader& shader, const Material& material)
+{
+    if (update_state(draw_state.material, { material.ka, material.kd, material.ks, material.q })) {
+        glUniform1f(shader.unif_loc(GLUnif::KA), material.ka);
+        glUniform1f(shader.unif_loc(GLUnif::KD), material.kd);
+        glUniform1f(shader.unif_loc(GLUnif::KS), material.ks);
+        glUniform1f(shader.unif_loc(GLUnif::Q), material.q);
+    }
+
+    // bind texture: packed ones share their array binding, untextured objects sample plain white
+    const GLTexture* texture = material_texture(material);
+    if (texture && texture->array) {
+        bind_texture(kUnitTextureArray, GL_TEXTURE_2D_ARRAY, texture->array->id);
+        set_texture_layer(shader, texture->layer);
+    } else if (texture && texture->virtual_texture) {
+        const GLVirtualTexture& vt = *texture->virtual_texture;
+        bind_texture(kUnitPageTable, GL_TEXTURE_2D, vt.page_table);
+        bind_texture(kUnitTileCache, GL_TEXTURE_2D, vt.cache->id);
+        set_texture_layer(shader, kLayerVirtual);
+        if (draw_state.virtual_texture != &vt) {
+            const GLsizei levels = GLsizei(vt.level_sizes.size());
+            glUniform2f(shader.unif_loc(GLUnif::TILE_CACHE_SIZE), float(vt.cache->pages_x * TiledTexture::kTileSize),
+                        float(vt.cache->pages_y * TiledTexture::kTileSize));
+            glUniform1i(shader.unif_loc(GLUnif::VIRTUAL_LEVELS), levels);
+            glUniform2fv(shader.unif_loc(GLUnif::VIRTUAL_LEVEL_SIZE), levels, glm::value_ptr(vt.level_sizes[0]));
+            glUniform1iv(shader.unif_loc(GLUnif::VIRTUAL_LEVEL_ROW), levels, vt.level_rows.data());
+            draw_state.virtual_texture = &vt;
+            render_stats.state_changes++;
+        }
+    } else if (texture) {
+        bind_texture(kUnitTexture2D, GL_TEXTURE_2D, texture->id);
+        set_texture_layer(shader, kLayerTexture2D);
+    } else {
+        set_texture_layer(shader, kLayerUntextured);
+    }
+}
+
+/// Max simplification error on screen, in pixels, for drawing a level of detail
+static float lod_threshold = 1.f;
+
+void set_lod_threshold(float pixels)
+{
+    lod_threshold = pixels;
+}
+
+/// Pick the coarsest level of detail of an object whose error stays under the threshold on screen
+static const std::vector<SubMesh>& select_lod(const GLObject& glo, const glm::mat4& model)
+{
+    if (glo.lods.empty())
+        return glo.submeshes;
+    const glm::vec3 center = model * glm::vec4(glo.bounds_center, 1.f);
+    const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+    const float distance = glm::distance(center, camera->position) - glo.bounds_radius * scale; // to the closest point
+    if (distance <= 0.f)
+        return glo.submeshes;
+    const float pixels_per_unit = pixels_per_unit_at_unit_distance / distance;
+    for (auto lod = glo.lods.rbegin(); lod != glo.lods.rend(); ++lod) {
+        if (lod->error * scale * pixels_per_unit <= lod_threshold)
+            return lod->submeshes;
+    }
+    return glo.submeshes;
+}
+
+/// Request the tiles of a submesh virtual texture its visible footprints need, at the mip level
+/// matching their size on screen
+static void request_virtual_tiles(const GLObject& glo, size_t submesh, const Material& material, const glm::mat4& model)
+{
+    if (submesh >= glo.footprints.size() || !material.diffuse_tex || !material.diffuse_tex->virtual_texture)
+        return;
+    GLVirtualTexture& vt = *material.diffuse_tex->virtual_texture;
+    const float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+    const float texels = std::sqrt(vt.level_sizes[0].x * vt.level_sizes[0].y);
+    const glm::mat3 rotation = glm::mat3(model) / scale;
+    for (const TexelFootprint& footprint : glo.footprints[submesh]) {
+        const glm::vec3 center = model * glm::vec4(footprint.center, 1.f);
+        const float radius = footprint.radius * scale;
+        if (std::any_of(frustum_planes.begin(), frustum_planes.end(),
+                        [&](const glm::vec4& plane) { return glm::dot(plane, glm::vec4(center, 1.f)) < -radius; }))
+            continue;
+        const glm::vec3 to_center = center - camera->position;
+        const float distance = glm::length(to_center);
+        if (footprint.cone > 0.f && distance > radius) { // every triangle faces away from the camera
+            const float facing = glm::dot(glm::normalize(rotation * footprint.normal), to_center / distance);
+            if (facing > std::sqrt(1.f - footprint.cone * footprint.cone) + radius / distance)
+                continue;
+        }
+        const float pixels_per_unit = scale * pixels_per_unit_at_unit_distance / std::max(distance - radius, 1e-3f);
+        const float texels_per_pixel = footprint.uv_density * texels / pixels_per_unit;
+        const size_t level = std::min(size_t(std::max(std::log2(texels_per_pixel), 0.f)), vt.level_sizes.size() - 1);
+        request_tiles(vt, level, footprint.uv_min, footprint.uv_max);
+    }
+}
+
+/// Add the draws of an object to a list, one per submesh of the level of detail in view
+static void collect_draws(const Object& obj, std::vector<DrawItem>& items)
+{
+    if (!obj.m_glo || !obj.m_glo->vao) // not uploaded yet
+        return;
+
+    const GLObject& glo = *obj.m_glo;
+    DrawItem item;
+    item.glo = &glo;
+    item.model = obj.m_transform.matrix();
+    item.color = obj.m_color ? *obj.m_color : WHITE;
+
+    // each submesh range with its own material
+    if (!glo.submeshes.empty() && glo.num_indices) {
+        const std::vector<SubMesh>& submeshes = select_lod(glo, item.model);
+        for (size_t i = 0; i < submeshes.size(); i++) {
+            const SubMesh& submesh = submeshes[i];
+            item.material = submesh.material ? submesh.material.get() : &obj.m_material;
+            request_virtual_tiles(glo, i, *item.material, item.model);
+            item.index_offset = submesh.index_offset;
+            item.index_count = submesh.index_count;
+            items.push_back(item);
+        }
         return;
+    }
+
+    // whole object
+    item.material = &obj.m_material;
+    item.index_count = glo.num_indices ? glo.num_indices : glo.num_vertices;
+    items.push_back(item);
+}
 
+/// Set the state of a draw, skipping what is already set, and issue it
+static void draw_item(const DrawItem& item)
+{
     // aliases
     const GLShader& shader = default_shader();
-    const GLObject& glo = *obj.m_glo;
+    const GLObject& glo = *item.glo;
+
+    if (update_state(draw_state.program, shader.id()))
+        glUseProgram(shader.id());
+    if (update_state(draw_state.vao, glo.vao.inner))
+        glBindVertexArray(glo.vao);
 
     // set uniforms
-    const glm::mat4 model = obj.m_transform.matrix();
-    glUniformMatrix4fv(shader.unif_loc(GLUnif::MODEL), 1, GL_FALSE, glm::value_ptr(model));
-    glUniform1f(shader.unif_loc(GLUnif::KA), obj.m_material.ka);
-    glUniform1f(shader.unif_loc(GLUnif::KD), obj.m_material.kd);
-    glUniform1f(shader.unif_loc(GLUnif::KS), obj.m_material.ks);
-    glUniform1f(shader.unif_loc(GLUnif::Q), obj.m_material.q);
+    if (update_state(draw_state.model, item.model))
+        glUniformMatrix4fv(shader.unif_loc(GLUnif::MODEL), 1, GL_FALSE, glm::value_ptr(item.model));
+    if (update_state(draw_state.position_offset, glo.position_offset))
+        glUniform3fv(shader.unif_loc(GLUnif::POSITION_OFFSET), 1, glm::value_ptr(glo.position_offset));
+    if (update_state(draw_state.position_scale, glo.position_scale))
+        glUniform3fv(shader.unif_loc(GLUnif::POSITION_SCALE), 1, glm::value_ptr(glo.position_scale));
+    if (update_state(draw_state.octahedral_normals, glo.octahedral_normals))
+        glUniform1i(shader.unif_loc(GLUnif::OCTAHEDRAL_NORMALS), glo.octahedral_normals);
+    if (update_state(draw_state.instanced, false))
+        glUniform1i(shader.unif_loc(GLUnif::INSTANCED), false);
 
     // set attribute default value
-    const Color color = obj.m_color ? *obj.m_color : WHITE;
-    glVertexAttrib4fv(shader.attr_loc(GLAttr::COLOR), (float*)&color);
+    if (update_state(draw_state.color, glm::vec4(item.color)))
+        glVertexAttrib4fv(shader.attr_loc(GLAttr::COLOR), glm::value_ptr(*draw_state.color));
 
-    // bind texture
-    const GLuint tex_id = obj.m_material.diffuse_tex ? obj.m_material.diffuse_tex->id : white_texture->id;
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, tex_id);
-    glUniform1i(shader.unif_loc(GLUnif::TEXTURE0), 0);
+    set_material(shader, *item.material);
+    if (glo.num_indices)
+        glDrawElements(GL_TRIANGLES, GLsizei(item.index_count), glo.index_type, (void*)(item.index_offset * index_type_size(glo.index_type)));
+    else
+        glDrawArrays(GL_TRIANGLES, 0, GLsizei(item.index_count));
+    render_stats.draw_calls++;
+    render_stats.triangles += item.index_count / 3;
+}
+
+/// Draw a generic object (textured or colored)
+void draw_object(const Object& obj) {
+    static std::vector<DrawItem> items; // reused to avoid allocating each draw
+    items.clear();
+    collect_draws(obj, items);
+    for (const DrawItem& item : items)
+        draw_item(item);
+}
 
-    // bind vao
-    glBindVertexArray(obj.m_glo->vao);
+/// Per-instance data of an instanced draw, as read by the instance attributes
+struct InstanceData {
+    float rows[3][4];  // affine model matrix, row major
+    uint8_t color[4];  // normalized RGBA
+};
+static_assert(sizeof(InstanceData) == 52);
 
-    // draw object
-    if (obj.m_glo->num_indices)
-        glDrawElements(GL_TRIANGLES, obj.m_glo->num_indices, obj.m_glo->index_type, nullptr);
-    else
-        glDrawArrays(GL_TRIANGLES, 0, obj.m_glo->num_vertices);
+/// Write the model matrix of a transform, same as Transform::matrix() (translate, rotate X, Y, Z, then scale)
+/// without the generic axis-angle rotations
+static void write_instance_matrix(const Transform& t, float rows[3][4])
+{
+    const float cx = std::cos(t.rotation.x), sx = std::sin(t.rotation.x);
+    const float cy = std::cos(t.rotation.y), sy = std::sin(t.rotation.y);
+    const float cz = std::cos(t.rotation.z), sz = std::sin(t.rotation.z);
+    const glm::vec3 s = t.scale.inner, p = t.position.inner;
+    const float r[3][3] = {
+        { cy * cz, -cy * sz, sy },
+        { cx * sz + sx * sy * cz, cx * cz - sx * sy * sz, -sx * cy },
+        { sx * sz - cx * sy * cz, sx * cz + cx * sy * sz, cx * cy },
+    };
+    for (int i = 0; i < 3; i++) {
+        rows[i][0] = r[i][0] * s.x;
+        rows[i][1] = r[i][1] * s.y;
+        rows[i][2] = r[i][2] * s.z;
+        rows[i][3] = p[i];
+    }
+}
+
+/// Point the instance attributes of the bound vertex array at the instance buffer, or turn them off
+static void set_instance_attrs(const GLShader& shader, bool enable)
+{
+    const GLAttr attrs[] = { GLAttr::INSTANCE_ROW0, GLAttr::INSTANCE_ROW1, GLAttr::INSTANCE_ROW2, GLAttr::INSTANCE_COLOR };
+    for (size_t i = 0; i < std::size(attrs); i++) {
+        const GLint loc = shader.attr_loc(attrs[i]);
+        if (!enable) {
+            glDisableVertexAttribArray(loc);
+            continue;
+        }
+        glEnableVertexAttribArray(loc);
+        if (attrs[i] == GLAttr::INSTANCE_COLOR)
+            glVertexAttribPointer(loc, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(InstanceData), (void*)offsetof(InstanceData, color));
+        else
+            glVertexAttribPointer(loc, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void*)(i * sizeof(float[4])));
+        glVertexAttribDivisor(loc, 1);
+    }
+}
+
+void draw_instanced(const GLObject& glo, const std::vector<Transform>& transforms, const std::vector<Color>& colors,
+                    const Material& material)
+{
+    if (!glo.vao || transforms.empty())
+        return;
+    if (!colors.empty() && colors.size() != transforms.size()) {
+        ERROR("Instanced draw with {} transforms but {} colors", transforms.size(), colors.size());
+        return;
+    }
+
+    // stream the instances into a fresh buffer storage, the driver keeps the previous one for draws in flight
+    if (!instance_buffer)
+        glGenBuffers(1, &instance_buffer.inner);
+    const size_t size = transforms.size() * sizeof(InstanceData);
+    glBindBuffer(GL_ARRAY_BUFFER, instance_buffer);
+    glBufferData(GL_ARRAY_BUFFER, GLsizeiptr(size), nullptr, GL_STREAM_DRAW);
+    auto* instances = static_cast<InstanceData*>(glMapBufferRange(GL_ARRAY_BUFFER, 0, GLsizeiptr(size),
+                                                                   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (!instances) {
+        ERROR("Failed to map the instance buffer ({} bytes)", size);
+        return;
+    }
+    for (size_t i = 0; i < transforms.size(); i++) {
+        write_instance_matrix(transforms[i], instances[i].rows);
+        const glm::vec4 color = colors.empty() ? glm::vec4(1.f) : glm::clamp(glm::vec4(colors[i]), 0.f, 1.f);
+        for (int c = 0; c < 4; c++)
+            instances[i].color[c] = uint8_t(color[c] * 255.f + 0.5f);
+    }
+    glUnmapBuffer(GL_ARRAY_BUFFER);
+
+    const GLShader& shader = default_shader();
+    if (update_state(draw_state.program, shader.id()))
+        glUseProgram(shader.id());
+    if (update_state(draw_state.vao, glo.vao.inner))
+        glBindVertexArray(glo.vao);
+    set_instance_attrs(shader, true);
+    if (update_state(draw_state.position_offset, glo.position_offset))
+        glUniform3fv(shader.unif_loc(GLUnif::POSITION_OFFSET), 1, glm::value_ptr(glo.position_offset));
+    if (update_state(draw_state.position_scale, glo.position_scale))
+        glUniform3fv(shader.unif_loc(GLUnif::POSITION_SCALE), 1, glm::value_ptr(glo.position_scale));
+    if (update_state(draw_state.octahedral_normals, glo.octahedral_normals))
+        glUniform1i(shader.unif_loc(GLUnif::OCTAHEDRAL_NORMALS), glo.octahedral_normals);
+    if (update_state(draw_state.instanced, true))
+        glUniform1i(shader.unif_loc(GLUnif::INSTANCED), true);
+    if (update_state(draw_state.color, glm::vec4(WHITE)))
+        glVertexAttrib4fv(shader.attr_loc(GLAttr::COLOR), glm::value_ptr(*draw_state.color));
+
+    const GLsizei count = GLsizei(transforms.size());
+    if (!glo.submeshes.empty() && glo.num_indices) {
+        const size_t index_size = index_type_size(glo.index_type);
+        for (const SubMesh& submesh : glo.submeshes) {
+            set_material(shader, submesh.material ? *submesh.material : material);
+            glDrawElementsInstanced(GL_TRIANGLES, GLsizei(submesh.index_count), glo.index_type,
+                                    (void*)(submesh.index_offset * index_size), count);
+            render_stats.draw_calls++;
+            render_stats.triangles += submesh.index_count / 3 * transforms.size();
+        }
+    } else {
+        set_material(shader, material);
+        if (glo.num_indices)
+            glDrawElementsInstanced(GL_TRIANGLES, GLsizei(glo.num_indices), glo.index_type, nullptr, count);
+        else
+            glDrawArraysInstanced(GL_TRIANGLES, 0, GLsizei(glo.num_vertices), count);
+        render_stats.draw_calls++;
+        render_stats.triangles += (glo.num_indices ? glo.num_indices : glo.num_vertices) / 3 * transforms.size();
+    }
+    // leave the vertex array as non-instanced draws expect it
+    set_instance_attrs(shader, false);
+}
+
+// Sort key, most significant first: what costs the most to change goes highest so that draws
+// sharing it end up together, and depth last so draws with the same state go front to back
+// (bits 63-56 shader, 55-40 texture, 39-24 vertex array, 23-16 material, 15-0 depth).
+static uint64_t draw_sort_key(const DrawItem& item, uint64_t material)
+{
+    const GLTexture* texture = material_texture(*item.material);
+    const GLuint texture_id = !texture ? 0 : texture->array ? texture->array->id.inner
+                            : texture->virtual_texture ? texture->virtual_texture->page_table.inner : texture->id.inner;
+    const GLObject& glo = *item.glo;
+    const glm::vec3 center = item.model * glm::vec4(glo.bounds_center, 1.f);
+    const float distance = glm::distance(center, camera->position);
+    uint32_t depth_bits; // the bits of a positive float order like the float
+    std::memcpy(&depth_bits, &distance, sizeof(depth_bits));
+    return uint64_t(default_shader().id() & 0xFF) << 56
+         | uint64_t(texture_id & 0xFFFF) << 40
+         | uint64_t(glo.vao.inner & 0xFFFF) << 24
+         | std::min<uint64_t>(material, 0xFF) << 16
+         | uint64_t(depth_bits >> 16);
+}
+
+void RenderQueue::submit(const Object& obj)
+{
+    const size_t first = items_.size();
+    collect_draws(obj, items_);
+    for (size_t i = first; i < items_.size(); i++) {
+        const Material& m = *items_[i].material;
+        // materials with the same values set the same uniforms, number them in order of appearance
+        const auto slot = materials_.try_emplace({ m.ka, m.kd, m.ks, m.q }, materials_.size()).first->second;
+        items_[i].key = draw_sort_key(items_[i], slot);
+    }
+}
+
+void RenderQueue::flush()
+{
+    std::sort(items_.begin(), items_.end(), [](const DrawItem& a, const DrawItem& b) { return a.key < b.key; });
+    for (const DrawItem& item : items_)
+        draw_item(item);
+    items_.clear();
+    materials_.clear();
 }
 
 
@@ -752,6 +2490,27 @@ void draw_ambient_light_point()
 // CREATION
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+GLObject& GLObject::operator=(GLObject&& o)
+{
+    std::swap(vbo.inner, o.vbo.inner);
+    std::swap(ebo.inner, o.ebo.inner);
+    std::swap(vao.inner, o.vao.inner);
+    num_vertices = o.num_vertices;
+    num_indices = o.num_indices;
+    index_type = o.index_type;
+    submeshes = std::move(o.submeshes);
+    lods = std::move(o.lods);
+    bounds_center = o.bounds_center;
+    bounds_radius = o.bounds_radius;
+    position_offset = o.position_offset;
+    position_scale = o.position_scale;
+    octahedral_normals = o.octahedral_normals;
+    footprints = std::move(o.footprints);
+    batch_layout = o.batch_layout;
+    batch_source = std::move(o.batch_source);
+    return *this;
+}
+
 /// Describes a Vertex Arrray layout and holds the vertex data pointers
 class VertexArray final {
   public:
@@ -769,11 +2528,11 @@ class VertexArray final {
     }
 
     template<typename T>
-    VertexArray& add_attr(GLAttr idx, size_t count) {
-        return add_attr_args(idx, count, GLType<T>::value, sizeof(T));
+    VertexArray& add_attr(GLAttr idx, size_t count, bool normalized = false) {
+        return add_attr_args(idx, count, GLType<T>::value, sizeof(T), normalized);
     }
 
-    VertexArray& add_attr_args(GLAttr idx, size_t count, GLenum type, size_t size) {
+    VertexArray& add_attr_args(GLAttr idx, size_t count, GLenum type, size_t size, bool normalized = false) {
         if (bindex < 0)
             return *this;
         auto& buf = buffers[bindex];
@@ -781,6 +2540,7 @@ class VertexArray final {
         attr.type = type;
         attr.count = count;
         attr.size = size;
+        attr.normalized = normalized;
         attr.offset = buf.stride;
         buf.stride += (count * size);
         total_stride += (count * size);
@@ -806,6 +2566,7 @@ class VertexArray final {
         size_t count = 0;
         size_t size = 0;
         size_t offset = 0;
+        bool normalized = false; // integer values map to [0,1] (unsigned) or [-1,1] (signed)
     };
 
     struct Buffer {
@@ -815,6 +2576,8 @@ class VertexArray final {
     };
 
   private:
+    friend auto batch_layout(const VertexArray& vertex_array) -> std::optional<BatchLayout>;
+
     Buffer buffers[(size_t)GLAttr::COUNT]; // we can have 1 buffer per attribute
     int bindex = -1;                       // index to buffers
     size_t num_vertices = 0;               // number of vertices
@@ -827,12 +2590,130 @@ class VertexArray final {
     friend GLObject create_globject(const GLShader& shader, const VertexArray& vertex_array, GLenum usage);
 };
 
+/// Vertex of a static batch, every attribute the primitives may have
+struct BatchVertex {
+    glm::vec3 position{ 0.f };
+    glm::vec2 texcoord{ 0.f };
+    glm::vec4 color{ 1.f };
+    glm::vec3 normal{ 0.f };
+};
+
+/// Vertices and indices of a small object read back from its buffers, to merge it into static batches
+struct BatchSource {
+    std::vector<BatchVertex> vertices;
+    std::vector<uint32_t> indices;
+    bool has_color = false; // otherwise the object color is baked in
+};
+
+/// Objects up to this many vertices can be static batched
+static constexpr size_t kMaxBatchSourceVertices = 1024;
+
+/// Where the attributes of a small vertex array made only of float attributes end up in its vertex
+/// buffer, nullopt for other arrays
+auto batch_layout(const VertexArray& vertex_array) -> std::optional<BatchLayout>
+{
+    if (vertex_array.num_vertices > kMaxBatchSourceVertices)
+        return std::nullopt;
+    BatchLayout layout;
+    layout.index_size = (vertex_array.indices && vertex_array.num_indices) ? uint32_t(vertex_array.index_size) : 0;
+    // buffers are laid out one after the other, as create_globject uploads them
+    size_t buf_offset = 0;
+    for (const auto& buffer : vertex_array.buffers) {
+        if (!buffer.ptr || !buffer.stride)
+            continue;
+        for (size_t attr_idx = 0; attr_idx < (size_t)GLAttr::COUNT; attr_idx++) {
+            const VertexArray::Attr& attr = buffer.attrs[attr_idx];
+            if (!attr.count || !attr.size)
+                continue;
+            if (attr.type != GL_FLOAT)
+                return std::nullopt;
+            BatchLayout::Attr* out = nullptr;
+            switch ((GLAttr)attr_idx) {
+                case GLAttr::POSITION: out = &layout.position; break;
+                case GLAttr::TEXCOORD: out = &layout.texcoord; break;
+                case GLAttr::COLOR: out = &layout.color; break;
+                case GLAttr::NORMAL: out = &layout.normal; break;
+                default: return std::nullopt;
+            }
+            *out = { uint32_t(buf_offset + attr.offset), uint32_t(buffer.stride), uint32_t(attr.count) };
+        }
+        buf_offset += buffer.stride * vertex_array.num_vertices;
+    }
+    if (!layout.position.count)
+        return std::nullopt;
+    return layout;
+}
+
+/// Read the vertices and indices of a small object back from its buffers, nullptr if they don't match
+/// its layout
+static auto read_batch_source(const GLObject& glo) -> Ref<const BatchSource>
+{
+    const BatchLayout& layout = *glo.batch_layout;
+    const auto read_buffer = [](GLuint buffer) {
+        GLint size = 0;
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        glGetBufferParameteriv(GL_COPY_READ_BUFFER, GL_BUFFER_SIZE, &size);
+        std::vector<uint8_t> data(size_t(std::max(size, 0)));
+        glGetBufferSubData(GL_COPY_READ_BUFFER, 0, GLsizeiptr(data.size()), data.data());
+        glBindBuffer(GL_COPY_READ_BUFFER, 0);
+        return data;
+    };
+
+    const std::vector<uint8_t> vertex_data = read_buffer(glo.vbo);
+    auto source = std::make_shared<BatchSource>();
+    source->vertices.resize(glo.num_vertices);
+    const auto read = [&](const BatchLayout::Attr& attr, float* out, size_t max) {
+        if (!attr.count)
+            return true;
+        if (glo.num_vertices && attr.offset + (glo.num_vertices - 1) * attr.stride + attr.count * sizeof(float) > vertex_data.size())
+            return false;
+        for (size_t v = 0; v < glo.num_vertices; v++) {
+            const uint8_t* in = vertex_data.data() + attr.offset + v * attr.stride;
+            std::memcpy(out + v * (sizeof(BatchVertex) / sizeof(float)), in, std::min<size_t>(attr.count, max) * sizeof(float));
+        }
+        return true;
+    };
+    if (!read(layout.position, &source->vertices[0].position.x, 3) || !read(layout.texcoord, &source->vertices[0].texcoord.x, 2)
+        || !read(layout.color, &source->vertices[0].color.x, 4) || !read(layout.normal, &source->vertices[0].normal.x, 3)) {
+        WARN("Vertex buffer {} is smaller than its layout, not batched", glo.vbo.inner);
+        return nullptr;
+    }
+    source->has_color = layout.color.count > 0;
+
+    // non-indexed objects get the trivial index list
+    if (!layout.index_size) {
+        source->indices.resize(glo.num_vertices);
+        std::iota(source->indices.begin(), source->indices.end(), 0u);
+        return source;
+    }
+    const std::vector<uint8_t> index_data = read_buffer(glo.ebo);
+    if (glo.num_indices * layout.index_size > index_data.size()) {
+        WARN("Index buffer {} is smaller than its layout, not batched", glo.ebo.inner);
+        return nullptr;
+    }
+    source->indices.resize(glo.num_indices);
+    for (size_t i = 0; i < glo.num_indices; i++) {
+        if (layout.index_size == 1)
+            source->indices[i] = index_data[i];
+        else if (layout.index_size == 2)
+            source->indices[i] = reinterpret_cast<const uint16_t*>(index_data.data())[i];
+        else
+            source->indices[i] = reinterpret_cast<const uint32_t*>(index_data.data())[i];
+        if (source->indices[i] >= glo.num_vertices) {
+            WARN("Index buffer {} refers to missing vertices, not batched", glo.ebo.inner);
+            return nullptr;
+        }
+    }
+    return source;
+}
+
 GLObject create_globject(const GLShader& shader, const VertexArray& vertex_array, GLenum usage = DEFAULT_GLO_USAGE)
 {
     GLuint vbo = 0, ebo = 0, vao = 0;
     glGenBuffers(1, &vbo);
     glGenVertexArrays(1, &vao);
     glBindVertexArray(vao);
+    draw_state.vao = vao;
     glBindBuffer(GL_ARRAY_BUFFER, vbo);
 
     // Keep track of enabled attributes
@@ -856,7 +2737,7 @@ GLObject create_globject(const GLShader& shader, const VertexArray& vertex_array
                 }
                 enabled_attrs[attr_idx] = true;
                 glEnableVertexAttribArray(attr_loc);
-                glVertexAttribPointer(attr_loc, attr.count, attr.type, GL_FALSE, buffer.stride, (void*)attr.offset);
+                glVertexAttribPointer(attr_loc, attr.count, attr.type, attr.normalized ? GL_TRUE : GL_FALSE, buffer.stride, (void*)attr.offset);
             }
         }
         size_t buf_size = (buffer.stride * vertex_array.num_vertices);
@@ -879,7 +2760,9 @@ GLObject create_globject(const GLShader& shader, const VertexArray& vertex_array
         glBufferData(GL_ELEMENT_ARRAY_BUFFER, size, vertex_array.indices, usage);
     }
 
-    return { vbo, ebo, vao, vertex_array.num_vertices, vertex_array.num_indices, vertex_array.index_type };
+    GLObject glo(vbo, ebo, vao, vertex_array.num_vertices, vertex_array.num_indices, vertex_array.index_type);
+    glo.batch_layout = batch_layout(vertex_array);
+    return glo;
 }
 
 GLObject create_globject(VertexArray vertex_array, GLenum usage = DEFAULT_GLO_USAGE)
@@ -887,6 +2770,89 @@ GLObject create_globject(VertexArray vertex_array, GLenum usage = DEFAULT_GLO_US
     return create_globject(default_shader(), vertex_array, usage);
 }
 
+void StaticBatcher::update(const std::vector<Object*>& objects)
+{
+    std::vector<std::pair<const Object*, const GLObject*>> members;
+    for (const Object* obj : objects) {
+        if (!obj->m_static || !obj->m_glo || !obj->m_glo->batch_layout)
+            continue;
+        GLObject& glo = *obj->m_glo;
+        if (!glo.batch_source) {
+            glo.batch_source = read_batch_source(glo);
+            if (!glo.batch_source)
+                glo.batch_layout.reset(); // don't read it again
+        }
+        if (glo.batch_source)
+            members.emplace_back(obj, &glo);
+    }
+    if (members == members_)
+        return;
+    members_ = std::move(members);
+    rebuild();
+}
+
+void StaticBatcher::rebuild()
+{
+    // group by what a draw sets: the texture and the material values
+    using Key = std::tuple<const GLTexture*, float, float, float, float>;
+    std::map<Key, std::vector<const Object*>> groups;
+    for (const auto& [obj, glo] : members_) {
+        const Material& m = obj->m_material;
+        groups[{ m.diffuse_tex.get(), m.ka, m.kd, m.ks, m.q }].push_back(obj);
+    }
+
+    batches_.clear();
+    batched_.clear();
+    std::vector<BatchVertex> vertices;
+    std::vector<uint32_t> indices;
+    for (const auto& [key, objects] : groups) {
+        vertices.clear();
+        indices.clear();
+        for (const Object* obj : objects) {
+            const BatchSource& source = *obj->m_glo->batch_source;
+            const glm::mat4 model = obj->m_transform.matrix();
+            const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(model)));
+            const glm::vec4 color = obj->m_color ? glm::vec4(*obj->m_color) : glm::vec4(WHITE);
+            const uint32_t base = uint32_t(vertices.size());
+            for (BatchVertex vertex : source.vertices) {
+                vertex.position = model * glm::vec4(vertex.position, 1.f);
+                if (vertex.normal != glm::vec3(0.f))
+                    vertex.normal = glm::normalize(normal_matrix * vertex.normal);
+                if (!source.has_color)
+                    vertex.color = color;
+                vertices.push_back(vertex);
+            }
+            for (uint32_t index : source.indices)
+                indices.push_back(base + index);
+            batched_.insert(obj);
+        }
+
+        auto va = VertexArray(vertices.size())
+            .add_buffer(vertices.data())
+            .add_attr<float>(GLAttr::POSITION, 3)
+            .add_attr<float>(GLAttr::TEXCOORD, 2)
+            .add_attr<float>(GLAttr::COLOR, 4)
+            .add_attr<float>(GLAttr::NORMAL, 3);
+        std::vector<uint16_t> indices16;
+        if (vertices.size() <= 0x10000) {
+            indices16.assign(indices.begin(), indices.end());
+            va.add_indices(indices16.data(), indices16.size());
+        } else {
+            va.add_indices(indices.data(), indices.size());
+        }
+        GLObject glo = create_globject(va, GL_STATIC_DRAW);
+        glo.batch_layout.reset(); // batches are not batched again
+        batches_.push_back(Object().glo(glo.to_ref()).material(objects.front()->m_material).scale(Size3(1.f)));
+    }
+    DEBUG("Static batching: {} objects into {} batches", batched_.size(), batches_.size());
+}
+
+void StaticBatcher::submit(RenderQueue& queue) const
+{
+    for (const Object& batch : batches_)
+        queue.submit(batch);
+}
+
 static auto cuboid_positions(Size3 s)
 {
     std::array<glm::vec3, 8> vertices = {glm::vec3
@@ -985,12 +2951,56 @@ Object create_color_cuboid(Size3 s, Color c[6], GLenum usage)
 
 Object create_texture_cuboid(Size3 size, GLTextureRef texture, GLenum usage)
 {
-    const auto vertices = cuboid_positions(size);
+    const auto p = cuboid_positions(size);
+    const glm::vec2 t[4] = { { 0.f, 1.f }, { 0.f, 0.f }, { 1.f, 0.f }, { 1.f, 1.f } };
+    const std::array<std::pair<glm::vec3, glm::vec2>, 24> vertices = {std::pair<glm::vec3, glm::vec2>
+        /* i    X ,   Y  ,   Z  ,  U ,  V  */
+        /* FRONT */
+        /*[ 0]*/ {p[0], t[0]},
+        /*[ 1]*/ {p[1], t[1]},
+        /*[ 2]*/ {p[2], t[2]},
+        /*[ 3]*/ {p[3], t[3]},
+        /* BACK */
+        /*[ 4]*/ {p[7], t[0]},
+        /*[ 5]*/ {p[6], t[1]},
+        /*[ 6]*/ {p[5], t[2]},
+        /*[ 7]*/ {p[4], t[3]},
+        /* LEFT */
+        /*[ 8]*/ {p[4], t[0]},
+        /*[ 9]*/ {p[5], t[1]},
+        /*[10]*/ {p[1], t[2]},
+        /*[11]*/ {p[0], t[3]},
+        /* RIGHT */
+        /*[12]*/ {p[3], t[0]},
+        /*[13]*/ {p[2], t[1]},
+        /*[14]*/ {p[6], t[2]},
+        /*[15]*/ {p[7], t[3]},
+        /* TOP */
+        /*[16]*/ {p[4], t[0]},
+        /*[17]*/ {p[0], t[1]},
+        /*[18]*/ {p[3], t[2]},
+        /*[19]*/ {p[7], t[3]},
+        /* BOTTOM */
+        /*[20]*/ {p[1], t[0]},
+        /*[21]*/ {p[5], t[1]},
+        /*[22]*/ {p[6], t[2]},
+        /*[23]*/ {p[2], t[3]},
+    };
+    const std::array<unsigned char, 36> indices = {
+        /* front  */  0,  1,  2,  2,  3,  0,
+        /* back   */  4,  5,  6,  6,  7,  4,
+        /* left   */  8,  9, 10, 10, 11,  8,
+        /* right  */ 12, 13, 14, 14, 15, 12,
+        /* top    */ 16, 17, 18, 18, 19, 16,
+        /* bottom */ 20, 21, 22, 22, 23, 20,
+    };
+    static_assert(sizeof(vertices[0]) == 5 * sizeof(float), "unexpected padding");
 
     auto va = VertexArray(vertices.size())
         .add_buffer(vertices.data())
         .add_attr<float>(GLAttr::POSITION, 3)
-        .add_attr<float>(GLAttr::TEXCOORD, 2);
+        .add_attr<float>(GLAttr::TEXCOORD, 2)
+        .add_indices(indices.data(), indices.size());
 
     return Object().glo(create_globject(va, usage).to_ref()).texture(texture);
 }
@@ -1084,20 +3094,142 @@ Object create_texture_rect(Size2 size, GLTextureRef texture, Rect r, GLenum usag
     return Object().glo(create_globject(va, usage).to_ref()).texture(texture);
 }
 
+/// Split each submesh into footprints by cells of a grid over texture coordinates
+static auto compute_texel_footprints(const Mesh& mesh) -> std::vector<std::vector<TexelFootprint>>
+{
+    constexpr int kGrid = 16;
+    constexpr size_t kStride = Mesh::kFloatsPerVertex;
+    const float* vertices = mesh.cooked ? mesh.cooked->vertices : mesh.vertices.data();
+    const auto index = [&](size_t i) -> size_t {
+        if (!mesh.cooked) return mesh.indices[i];
+        if (mesh.cooked->index_type == GL_UNSIGNED_SHORT) return ((const uint16_t*)mesh.cooked->indices)[i];
+        return ((const uint32_t*)mesh.cooked->indices)[i];
+    };
+    const auto position = [&](size_t v) { return glm::make_vec3(vertices + v * kStride); };
+    const auto texcoord = [&](size_t v) { return glm::make_vec2(vertices + v * kStride + 3); };
+
+    struct Cell {
+        TexelFootprint footprint;
+        glm::vec3 min{ std::numeric_limits<float>::max() }, max{ std::numeric_limits<float>::lowest() };
+        float area = 0.f, uv_area = 0.f;
+        bool used = false;
+    };
+    std::vector<std::vector<TexelFootprint>> footprints;
+    for (const SubMesh& submesh : mesh.submeshes) {
+        std::vector<Cell> cells(kGrid * kGrid);
+        const auto cell_of = [&](size_t t) -> Cell& {
+            const glm::vec2 uv = (texcoord(index(t)) + texcoord(index(t + 1)) + texcoord(index(t + 2))) / 3.f;
+            const glm::ivec2 c = glm::clamp(glm::ivec2(uv * float(kGrid)), 0, kGrid - 1);
+            return cells[c.y * kGrid + c.x];
+        };
+        const auto normal_of = [&](size_t t) {
+            return glm::cross(position(index(t + 1)) - position(index(t)), position(index(t + 2)) - position(index(t)));
+        };
+        // bounds, texture area and facing of the triangles in each cell
+        const size_t end = submesh.index_offset + submesh.index_count;
+        for (size_t t = submesh.index_offset; t + 2 < end; t += 3) {
+            Cell& cell = cell_of(t);
+            const glm::vec3 n = normal_of(t);
+            const glm::vec2 uv0 = texcoord(index(t)), uv1 = texcoord(index(t + 1)), uv2 = texcoord(index(t + 2));
+            if (!cell.used) {
+                cell.footprint.uv_min = cell.footprint.uv_max = uv0;
+                cell.used = true;
+            }
+            for (size_t k = 0; k < 3; k++) {
+                cell.min = glm::min(cell.min, position(index(t + k)));
+                cell.max = glm::max(cell.max, position(index(t + k)));
+                cell.footprint.uv_min = glm::min(cell.footprint.uv_min, texcoord(index(t + k)));
+                cell.footprint.uv_max = glm::max(cell.footprint.uv_max, texcoord(index(t + k)));
+            }
+            cell.footprint.normal += n; // area weighted
+            cell.area += 0.5f * glm::length(n);
+            const glm::vec2 e1 = uv1 - uv0, e2 = uv2 - uv0;
+            cell.uv_area += 0.5f * std::abs(e1.x * e2.y - e1.y * e2.x);
+        }
+        for (Cell& cell : cells) {
+            cell.footprint.center = (cell.min + cell.max) * 0.5f;
+            const float length = glm::length(cell.footprint.normal);
+            cell.footprint.normal = length > 0.f ? cell.footprint.normal / length : glm::vec3(0.f);
+            cell.footprint.cone = length > 0.f ? 1.f : -1.f;
+            cell.footprint.uv_density = cell.area > 0.f ? std::sqrt(cell.uv_area / cell.area) : 0.f;
+        }
+        // bounding radius and widest triangle angle from the average direction
+        for (size_t t = submesh.index_offset; t + 2 < end; t += 3) {
+            TexelFootprint& footprint = cell_of(t).footprint;
+            for (size_t k = 0; k < 3; k++)
+                footprint.radius = std::max(footprint.radius, glm::distance(footprint.center, position(index(t + k))));
+            const glm::vec3 n = normal_of(t);
+            if (footprint.cone >= 0.f && glm::length(n) > 0.f)
+                footprint.cone = std::min(footprint.cone, glm::dot(footprint.normal, glm::normalize(n)));
+        }
+        std::vector<TexelFootprint>& result = footprints.emplace_back();
+        for (Cell& cell : cells) {
+            if (!cell.used)
+                continue;
+            if (cell.footprint.cone <= 0.f) // triangles facing opposite sides, never culled
+                cell.footprint.cone = -1.f;
+            result.push_back(cell.footprint);
+        }
+    }
+    return footprints;
+}
+
+/// Load a mesh and its index ranges into GPU buffers
+static GLObject create_mesh_globject(const Mesh& mesh, GLenum usage)
+{
+    const MeshUploadData data = prepare_mesh_upload(mesh);
+    auto va = VertexArray(data.num_vertices);
+    if (mesh.vertex_format == VertexFormat::COMPRESSED) {
+        va.add_buffer(data.vertices)
+            .add_attr<unsigned short>(GLAttr::POSITION, 4, true)
+            .add_attr<Half>(GLAttr::TEXCOORD, 2)
+            .add_attr<short>(GLAttr::NORMAL, 2, true);
+    } else {
+        va.add_buffer(data.vertices)
+            .add_attr<float>(GLAttr::POSITION, 3)
+            .add_attr<float>(GLAttr::TEXCOORD, 2)
+            .add_attr<float>(GLAttr::NORMAL, 3);
+    }
+    va.add_indices_args((void*)data.indices, data.num_indices, data.index_type, index_type_size(data.index_type));
+
+    GLObject glo = create_globject(va, usage);
+    glo.batch_layout.reset(); // models draw by submesh, they are not batched
+    glo.submeshes = mesh.submeshes;
+    glo.lods = mesh.lods;
+    glo.bounds_center = mesh.center;
+    glo.bounds_radius = mesh.radius;
+    if (virtual_texture_threshold > 0)
+        glo.footprints = compute_texel_footprints(mesh);
+    if (mesh.vertex_format == VertexFormat::COMPRESSED) {
+        glo.position_offset = data.position_offset;
+        glo.position_scale = data.position_scale;
+        glo.octahedral_normals = true;
+    }
+    return glo;
+}
+
 /// Create a mesh object with texture loaded into GPU buffers
 Object create_mesh(const Mesh& mesh, GLenum usage)
 {
-    constexpr auto kFloatsPerVertex = 3 + 2 + 3;
-    auto va = VertexArray(mesh.vertices.size() / kFloatsPerVertex)
-        .add_buffer(mesh.vertices.data())
-        .add_attr<float>(GLAttr::POSITION, 3)
-        .add_attr<float>(GLAttr::TEXCOORD, 2)
-        .add_attr<float>(GLAttr::NORMAL, 3);
+    auto glo = create_mesh_globject(mesh, usage).to_ref();
+    track_globject(mesh, glo, usage);
+    return Object().glo(glo);
+}
 
-    auto obj = Object().glo(create_globject(va, usage).to_ref());
-    if (mesh.material)
-        obj.material(*mesh.material);
-    return obj;
+/// Create a mesh object uploaded to GPU buffers on the first frame after the model finishes loading
+Object create_mesh_async(std::shared_future<ModelRef> model, GLenum usage)
+{
+    auto glo = GLObject{}.to_ref();
+    post_upload([glo, model = std::move(model), usage] {
+        if (model.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+            return false;
+        if (const ModelRef& loaded = model.get()) {
+            *glo = create_mesh_globject(loaded->mesh, usage);
+            track_globject(loaded->mesh, glo, usage);
+        }
+        return true;
+    });
+    return Object().glo(glo);
 }
 
 } // namespace sgl
@@ -1,8 +1,10 @@
 #pragma once
 
+#include <future>
 #include <map>
 #include <memory>
 #include <optional>
+#include <unordered_set>
 #include <string_view>
 
 #include <glm/vec2.hpp>
@@ -18,35 +20,16 @@
 
 #include <GLFW/glfw3.h>
 
+#include "sgl_assets.hpp"
+
 /// Simple Graphics Library
 namespace sgl {
 
 
-///////////////////////////////////////////////////////////////////////////////////////////////////
-// LOG
-///////////////////////////////////////////////////////////////////////////////////////////////////
-
-#define TRACE SPDLOG_TRACE
-#define DEBUG SPDLOG_DEBUG
-#define INFO SPDLOG_INFO
-#define WARN SPDLOG_WARN
-#define ERROR SPDLOG_ERROR
-#define CRITICAL SPDLOG_CRITICAL
-#define ABORT_MSG(...) do { CRITICAL(__VA_ARGS__); std::abort(); } while (0)
-#define ASSERT_MSG(expr, ...) do { if (expr) { } else { ABORT_MSG(__VA_ARGS__); } } while (0)
-#define ASSERT(expr) ASSERT_MSG(expr, "Assertion failed: ({})", #expr)
-#define ASSERT_RET(expr) [&]{ auto ret = (expr); ASSERT_MSG(ret, "Assertion failed: ({})", #expr); return ret; }()
-#define DBG(expr) [&]{ auto ret = (expr); DEBUG("({}) = {{{}}}", #expr, ret); return ret; }()
-
-
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // UTILS
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Default core reference type
-template<typename ...T>
-using Ref = std::shared_ptr<T...>;
-
 /// Utility type to make unique numbers (IDs) movable, when moved the value should be zero
 template<typename T>
 struct UniqueNum final {
@@ -60,9 +43,6 @@ struct UniqueNum final {
   operator T() const { return inner; }
 };
 
-/// Read file contents to a string
-auto read_file_to_string(const std::string& filename) -> std::optional<std::string>;
-
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // COLORS
@@ -103,6 +83,10 @@ enum class GLAttr {
     COLOR,
     TEXCOORD,
     NORMAL,
+    INSTANCE_ROW0, // rows of the affine model matrix of an instance
+    INSTANCE_ROW1,
+    INSTANCE_ROW2,
+    INSTANCE_COLOR,
     COUNT, // must be last
 };
 
@@ -119,6 +103,18 @@ enum class GLUnif {
     LIGHT_POSITION,
     LIGHT_COLOR,
     CAMERA_POSITION,
+    POSITION_OFFSET,
+    POSITION_SCALE,
+    OCTAHEDRAL_NORMALS,
+    TEXTURE_ARRAY,
+    TEXTURE_LAYER,
+    PAGE_TABLE,
+    TILE_CACHE,
+    TILE_CACHE_SIZE,
+    VIRTUAL_LEVELS,
+    VIRTUAL_LEVEL_SIZE,
+    VIRTUAL_LEVEL_ROW,
+    INSTANCED,
     COUNT, // must be last
 };
 
@@ -147,6 +143,9 @@ class GLShader final {
     /// Get shader program name
     [[nodiscard]] std::string_view name() const { return name_; }
 
+    /// Get shader program ID
+    [[nodiscard]] GLuint id() const { return id_; }
+
     /// Bind shader program
     void bind() { glUseProgram(id_); }
     /// Unbind shader program
@@ -187,63 +186,104 @@ const GLShader& default_shader();
 // TEXTURE
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Represents a texture loaded to GPU memory
+/// Same-sized textures of one format packed as the layers of a GL_TEXTURE_2D_ARRAY
+struct GLTextureArray;
+
+/// Texture streamed by tiles, only the tiles on screen are kept in GPU memory
+struct GLVirtualTexture;
+
+/// Represents a texture loaded to GPU memory, either its own GL_TEXTURE_2D or a layer of a texture array
 struct GLTexture final {
-    UniqueNum<GLuint> id;
+    UniqueNum<GLuint> id;        // GL_TEXTURE_2D, 0 when packed in a texture array
+    Ref<GLTextureArray> array;   // texture array holding it otherwise
+    int layer = -1;
+    Ref<GLVirtualTexture> virtual_texture; // or tiles streamed by visibility, for large images
 
-    ~GLTexture() {
-        if (id) glDeleteTextures(1, &id.inner);
-    }
+    GLTexture() = default;
+    explicit GLTexture(GLuint id) : id(id) {}
+    ~GLTexture();
 
     // Movable but not Copyable
     GLTexture(GLTexture&&) = default;
     GLTexture(const GLTexture&) = delete;
-    GLTexture& operator=(GLTexture&&) = default;
+    /// Swaps contents, the previous ones are released along with `o`
+    GLTexture& operator=(GLTexture&& o);
     GLTexture& operator=(const GLTexture&) = delete;
 
+    /// Whether the texture has contents, async loaded textures are empty until uploaded
+    bool is_loaded() const { return id || array || virtual_texture; }
+
     Ref<GLTexture> to_ref() { return std::make_shared<GLTexture>(std::move(*this)); }
 };
 
-using GLTextureRef = Ref<GLTexture>;
+/// Set how textures loaded afterwards are cooked: with precomputed mip levels, block-compressed
+/// and kept in the texture cache by default (compression is off when the GPU lacks S3TC)
+void set_texture_options(const TextureCookOptions& options);
 
 /// Load a texture file from give path into GPU memory
 GLTextureRef load_texture(std::string_view path, GLenum filter);
 
+/// Load a texture file in the background: it is decoded by a loader thread and uploaded
+/// within a later frame's upload budget, until then the returned texture is empty (id 0)
+GLTextureRef load_texture_async(std::string_view path, GLenum filter);
+
+/// Set whether loaded textures are packed into texture arrays (the default), so objects using
+/// textures of the same size and format draw without rebinding textures
+void set_texture_arrays(bool enable);
+
+/// Set the image size (width or height, in texels) from which textures load as virtual textures:
+/// cut into tiles, of which only those on screen are streamed into GPU memory. 0 disables them (default).
+/// Only objects drawn from meshes request tiles, other objects show the coarsest level.
+void set_virtual_texture_threshold(int texels);
+
+/// Set the GPU memory of the tile cache of each virtual texture format, for caches created afterwards
+void set_virtual_texture_budget(size_t bytes);
+
+/// Set whether texture data is staged through a ring of pixel buffers (the default), letting the
+/// driver copy it to GPU memory asynchronously, or passed straight from client memory
+void set_pixel_buffer_uploads(bool enable);
+
+/// Create a texture for frequent updates (video, procedural), uncompressed RGBA without mip levels
+GLTextureRef create_stream_texture(int width, int height, GLenum filter);
+
+/// Replace a region of a stream texture with tightly packed 8-bit RGBA pixels. The pixels are copied
+/// into a pixel buffer and transferred while rendering goes on, the memory can be reused on return.
+void update_stream_texture(const GLTexture& texture, int x, int y, int width, int height, const void* pixels);
+
+/// Load several texture files at once, decoding them in parallel on the loader threads.
+/// Returns once all are uploaded, with a null texture for each file failing to load
+/// (call from the render thread, as load_texture()).
+std::vector<GLTextureRef> load_textures(const std::vector<std::string>& paths, GLenum filter);
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-// MATERIAL
+// MESH/MODEL
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-struct Material {
-    float ka = 1.0f;
-    float kd = 1.0f;
-    float ks = 1.0f;
-    float q  = 1.0f;
-    GLTextureRef diffuse_tex;
+/// Load an OBJ model meshes and materials from file
+/// (a cooked copy is kept in the mesh cache and reused while the OBJ/MTL files are unchanged)
+ModelRef load_model(std::string_view filepath, const ModelLoadOptions& options = {});
 
-    Ref<Material> to_ref() { return std::make_shared<Material>(std::move(*this)); }
-};
-using MaterialRef = Ref<Material>;
+/// Load an OBJ model in the background on a loader thread,
+/// its material textures are then loaded with load_texture_async().
+/// The future becomes ready within a later frame's uploads, so don't block the render thread on it.
+std::shared_future<ModelRef> load_model_async(std::string_view filepath, const ModelLoadOptions& options = {});
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
-// MESH/MODEL
+// HOT RELOAD
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
-/// Represents one mesh with its vertices and material
-struct Mesh {
-    std::vector<float> vertices;
-    MaterialRef material;
-};
+/// Called on the render thread once a changed file is reloaded and in use,
+/// `latency` is the time in seconds since the change was detected
+typedef void (* FnReloadHandler)(std::string_view path, double latency, void* cookie);
 
-/// Represents a loaded Model file with multiple meshes
-struct Model {
-    Mesh meshes[1]; // support only 1 mesh for now
-};
-using ModelRef = Ref<Model>;
+/// Watch the OBJ, MTL and texture files of loaded assets and reload them when changed on disk (Linux only).
+/// Only the changed file is parsed again, in the background, and objects use the new GPU data from the next frame on.
+void set_hot_reload(bool enable);
 
-/// Load an OBJ model meshes and materials from file
-ModelRef load_model(std::string_view filepath);
+/// Set handler notified of every hot reload
+void set_reload_callback(FnReloadHandler callback, void* cookie);
 
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -361,14 +401,53 @@ struct Transform {
 // OBJECTS
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 
+/// Part of a submesh whose texture coordinates fall in one cell of a grid over the texture,
+/// to estimate on the CPU which tiles of a virtual texture are on screen and at what mip level
+struct TexelFootprint {
+    glm::vec2 uv_min{ 0.f }, uv_max{ 0.f }; // texture area covered
+    glm::vec3 center{ 0.f };                // bounding sphere, in mesh units
+    float radius = 0.f;
+    glm::vec3 normal{ 0.f };                // average direction the triangles face
+    float cone = -1.f;                      // cosine of the widest angle between a triangle and `normal`
+    float uv_density = 0.f;                 // texture coordinate units per mesh unit
+};
+
+/// Where the float attributes of a small object are in its vertex buffer, so a StaticBatcher can read
+/// its vertices back from the GPU when it is first batched
+struct BatchLayout {
+    struct Attr {
+        uint32_t offset = 0; // bytes from the start of the vertex buffer to the first vertex
+        uint32_t stride = 0;
+        uint32_t count = 0;  // floats per vertex, 0 when absent
+    };
+    Attr position, texcoord, color, normal;
+    uint32_t index_size = 0; // bytes per index, 0 when not indexed
+};
+
+struct BatchSource;
+
 /// Represents an object loaded into GPU memory buffers
 struct GLObject final {
     UniqueNum<GLuint> vbo;
     UniqueNum<GLuint> ebo;
     UniqueNum<GLuint> vao;
-    size_t num_vertices;
-    size_t num_indices;
-    GLenum index_type;
+    size_t num_vertices = 0;
+    size_t num_indices = 0;
+    GLenum index_type = 0;
+    std::vector<SubMesh> submeshes; // index ranges drawn with their own material (Object material for ranges without one)
+    std::vector<MeshLod> lods;      // simplified index ranges, drawn instead of submeshes when small on screen
+    glm::vec3 bounds_center{ 0.f }; // bounding sphere of the vertices
+    float bounds_radius = 0.f;
+    glm::vec3 position_offset{ 0.f }; // decodes quantized positions: offset + position * scale
+    glm::vec3 position_scale{ 1.f };
+    bool octahedral_normals = false;  // normals are octahedral encoded in 2 components
+    std::vector<std::vector<TexelFootprint>> footprints; // of each submesh, when virtual textures are enabled
+    std::optional<BatchLayout> batch_layout; // set for objects small enough to be static batched
+    Ref<const BatchSource> batch_source;     // their vertices, read back by the first StaticBatcher using them
+
+    GLObject() = default;
+    GLObject(GLuint vbo, GLuint ebo, GLuint vao, size_t num_vertices, size_t num_indices, GLenum index_type)
+        : vbo(vbo), ebo(ebo), vao(vao), num_vertices(num_vertices), num_indices(num_indices), index_type(index_type) {}
 
     ~GLObject() {
         if (vbo) glDeleteBuffers(1, &vbo.inner);
@@ -379,7 +458,8 @@ struct GLObject final {
     // Movable but not Copyable
     GLObject(GLObject&&) = default;
     GLObject(const GLObject&) = delete;
-    GLObject& operator=(GLObject&&) = default;
+    /// Swaps buffers, the previous ones are released along with `o`
+    GLObject& operator=(GLObject&& o);
     GLObject& operator=(const GLObject&) = delete;
 
     Ref<GLObject> to_ref() { return std::make_shared<GLObject>(std::move(*this)); }
@@ -399,6 +479,9 @@ struct Object {
     Object& material(Material m) { m_material = std::move(m); return *this; }
     Object& texture(GLTextureRef t) { m_material.diffuse_tex = std::move(t); return *this; }
 
+    bool m_static = false; // never moves, may be merged with other static objects by a StaticBatcher
+    Object& make_static(bool s = true) { m_static = s; return *this; }
+
     Transform m_transform;
     Object& scale(Size3 s) { m_transform.scale = s; return *this; }
     Object& rotate(glm::vec3 r) { m_transform.rotation = r; return *this; }
@@ -443,6 +526,23 @@ void begin_render(Color color);
 /// End rendering procedure
 void end_render();
 
+/// Set the time spent each frame (in begin_render) uploading async loaded assets to the GPU
+void set_upload_budget(double seconds);
+
+/// Counters of the rendering work, reset by begin_render
+struct RenderStats {
+    size_t draw_calls = 0;
+    size_t triangles = 0;
+    size_t texture_binds = 0;
+    size_t state_changes = 0; // program, vertex array, texture bindings and uniform values set for drawing
+};
+
+/// Get the rendering counters of the current (or last ended) frame
+const RenderStats& get_render_stats();
+
+/// Set how much simplification error, in pixels on screen, objects may show when drawn with a level of detail
+void set_lod_threshold(float pixels);
+
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // DRAWING
@@ -451,6 +551,64 @@ void end_render();
 /// Draw any object using default settings
 void draw_object(const Object& obj);
 
+/// One draw call: a submesh range of an object with its material
+struct DrawItem {
+    uint64_t key = 0; // sort order in a RenderQueue
+    const GLObject* glo = nullptr;
+    const Material* material = nullptr;
+    glm::mat4 model{ 1.f };
+    Color color;
+    size_t index_offset = 0;
+    size_t index_count = 0; // or vertex count, for objects without indices
+};
+
+/// Draws collected over a frame and issued sorted by shader, texture, vertex array, material and depth,
+/// so that consecutive draws share their state. Submitted objects must stay alive until flush.
+class RenderQueue final {
+  public:
+    /// Queue the draws of an object
+    void submit(const Object& obj);
+    /// Issue the queued draws in sorted order and empty the queue
+    void flush();
+
+    [[nodiscard]] size_t size() const { return items_.size(); }
+
+  private:
+    std::vector<DrawItem> items_;
+    std::map<std::array<float, 4>, size_t> materials_; // order of appearance of material values
+};
+
+/// Merges static objects sharing a material into combined vertex buffers, pre-transformed,
+/// so that scenes made of many small primitives draw in a handful of calls. Only objects flagged
+/// static and small enough (such as the primitives of create_*) are merged, their vertices are read
+/// back from the GPU once, the first time they are batched.
+class StaticBatcher final {
+  public:
+    /// Take the static objects of a scene, rebuilding the batches only when they differ from the last
+    /// time. The objects must stay alive while batched.
+    void update(const std::vector<Object*>& objects);
+    /// Rebuild on the next update, for static objects that were moved after all
+    void invalidate() { members_.clear(); }
+    /// Whether an object is drawn by a batch, and must not be drawn on its own
+    [[nodiscard]] bool contains(const Object& obj) const { return batched_.count(&obj) > 0; }
+    /// Queue the draws of the batches
+    void submit(RenderQueue& queue) const;
+
+    [[nodiscard]] size_t num_batches() const { return batches_.size(); }
+
+  private:
+    void rebuild();
+
+    std::vector<std::pair<const Object*, const GLObject*>> members_; // objects batched and their buffers
+    std::unordered_set<const Object*> batched_;
+    std::vector<Object> batches_;
+};
+
+/// Draw copies of an object in one call, each with its own transform and color (or white when no colors
+/// are given), and the submesh materials or `material`. Drawn right away, without a RenderQueue.
+void draw_instanced(const GLObject& glo, const std::vector<Transform>& transforms, const std::vector<Color>& colors = {},
+                    const Material& material = {});
+
 /// Draw ambient light point for checking where it is
 void draw_ambient_light_point();
 
@@ -477,7 +635,7 @@ Object create_texture_rect(Size2 size, GLTextureRef texture, GLenum usage = DEFA
 Object create_texture_rect(Size2 size, GLTextureRef texture, Rect texcoord, GLenum usage = DEFAULT_GLO_USAGE);
 
 /// Create a simple textured cuboid and load it into GPU buffers
-//Object create_texture_cuboid(Size3 size, GLTextureRef texture);
+Object create_texture_cuboid(Size3 size, GLTextureRef texture, GLenum usage = DEFAULT_GLO_USAGE);
 
 //GLObject create_color_cube_glo(Size3 size, Color color);
 //GLObject create_color_cube_glo(Size3 size, Color color, GLenum usage);
@@ -486,8 +644,13 @@ Object create_texture_rect(Size2 size, GLTextureRef texture, Rect texcoord, GLen
 //GLObject create_color_mesh_glo(const GLShader& shader, Size3 size, Color color, GLenum usage);
 
 /// Create a mesh object with texture loaded into GPU buffers
+/// (meshes with more than one material are drawn with one call per submesh)
 Object create_mesh(const Mesh& mesh, GLenum usage = DEFAULT_GLO_USAGE);
 
+/// Create a mesh object from a model still loading in the background,
+/// its GPU buffers are uploaded once the model is ready and it is not drawn before that
+Object create_mesh_async(std::shared_future<ModelRef> model, GLenum usage = DEFAULT_GLO_USAGE);
+
 
 } // namespace sgl
 